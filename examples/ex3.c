@@ -0,0 +1,89 @@
+/* In-process thread supervisor example, press Ctrl-C to exit ...
+ *
+ * Copyright (c) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "wdog.h"
+
+#define WORKERS 4
+
+/* Return zero to drop the thread, non-zero to let watchdogd act */
+static int failed(int id, const char *label, void *arg)
+{
+	(void)arg;
+	fprintf(stderr, "Thread %s (%d) missed its deadline!\n", label, id);
+
+	return 1;
+}
+
+static void *worker(void *arg)
+{
+	long num = (long)arg;
+	unsigned int ack;
+	char label[16];
+	int id, i;
+
+	snprintf(label, sizeof(label), "worker%ld", num);
+	id = wdog_thread_subscribe(label, 500, &ack); /* 500 usec */
+	if (id < 0) {
+		perror("Failed subscribing thread");
+		return NULL;
+	}
+
+	for (i = 0; ; i++) {
+		usleep(100);	/* Work ... */
+
+		/* Last worker stalls after a while */
+		if (num == WORKERS - 1 && i == 100000)
+			sleep(1);
+
+		if (wdog_thread_kick(id, &ack))
+			break;
+	}
+
+	return NULL;
+}
+
+int main(void)
+{
+	pthread_t tid[WORKERS];
+	long i;
+
+	if (wdog_thread_init(NULL, 2000, failed, NULL)) {
+		perror("Failed starting thread supervisor");
+		return 1;
+	}
+
+	printf("Press Ctrl-C to exit.\n");
+	for (i = 0; i < WORKERS; i++)
+		pthread_create(&tid[i], NULL, worker, (void *)i);
+
+	for (i = 0; i < WORKERS; i++)
+		pthread_join(tid[i], NULL);
+
+	return wdog_thread_exit();
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -20,6 +20,10 @@
 #include <sys/un.h>
 #include "wdt.h"
 #include "conf.h"
+#include "history.h"
+#include "lagmon.h"
+#include "realtime.h"
+#include "reexec.h"
 #include "supervisor.h"
 
 static int     sd = -1;
@@ -30,7 +34,7 @@ extern const char *__wdog_levellog(int log);
 
 
 /* Client connected to domain socket sent a request */
-static void cmd(uev_t *w, void *arg, int events)
+static void request(uev_t *w, void *arg, int events)
 {
 	const char *tmp;
 	ssize_t num;
@@ -44,6 +48,8 @@ static void cmd(uev_t *w, void *arg, int events)
 		return;
 	}
 
+	/* Older clients leave payload fields they don't know of zeroed */
+	memset(&req, 0, sizeof(req));
 	num = read(sd, &req, sizeof(req));
 	if (num <= 0) {
 		close(sd);
@@ -58,8 +64,29 @@ static void cmd(uev_t *w, void *arg, int events)
 	DEBUG("cmd %d", req.cmd);
 
 	/* Special handling for list clients - sends multiple responses */
-	if (req.cmd == WDOG_LIST_SUPV_CLIENTS_CMD) {
-		if (supervisor_list_clients(sd) < 0) {
+	if (req.cmd == WDOG_LIST_SUPV_CLIENTS_CMD || req.cmd == WDOG_CLIENT_STATS_CMD) {
+		if (supervisor_list_clients(sd, req.cmd) < 0) {
+			req.cmd = WDOG_CMD_ERROR;
+			req.error = EOPNOTSUPP;
+			if (write(sd, &req, sizeof(req)) != sizeof(req))
+				WARN("Failed sending error reply");
+		}
+		shutdown(sd, SHUT_RDWR);
+		close(sd);
+		return;
+	}
+
+	if (req.cmd == WDOG_HISTORY_CMD || req.cmd == WDOG_DEVICES_CMD ||
+	    req.cmd == WDOG_REALTIME_CMD) {
+		int rc;
+
+		if (req.cmd == WDOG_HISTORY_CMD)
+			rc = history_list(sd);
+		else if (req.cmd == WDOG_REALTIME_CMD)
+			rc = realtime_list(sd);
+		else
+			rc = wdt_list(sd);
+		if (rc < 0) {
 			req.cmd = WDOG_CMD_ERROR;
 			req.error = EOPNOTSUPP;
 			if (write(sd, &req, sizeof(req)) != sizeof(req))
@@ -109,15 +136,32 @@ static void cmd(uev_t *w, void *arg, int events)
 			wdt_init(w->ctx, NULL);
 		break;
 
+	case WDOG_UPGRADE_CMD:
+		/* Reply first, on success we never return from reexec() */
+		if (write(sd, &req, sizeof(req)) != sizeof(req))
+			WARN("Failed sending reply to %s[%d]", req.label, req.pid);
+		shutdown(sd, SHUT_RDWR);
+		close(sd);
+
+		if (reexec())
+			ERROR("Upgrade failed, continuing with current version.");
+		return;
+
 	case WDOG_SUBSCRIBE_CMD:
 	case WDOG_UNSUBSCRIBE_CMD:
 	case WDOG_KICK_CMD:
+	case WDOG_THROUGHPUT_CMD:
+	case WDOG_LATENCY_CMD:
+	case WDOG_STAGE_CMD:
+	case WDOG_CHECKPOINT_CMD:
+	case WDOG_JOIN_CMD:
 	case WDOG_RESET_CMD:
 	case WDOG_RESET_COUNTER_CMD:
 	case WDOG_RESET_REASON_CMD:
 	case WDOG_RESET_REASON_RAW_CMD:
 	case WDOG_CLEAR_REASON_CMD:
 	case WDOG_FAILED_SYSTEMOK_CMD...WDOG_FAILED_OVERLOAD_CMD:
+	case WDOG_FAILED_CODE_CMD:
 		DEBUG("Delegating %d to supervisor", req.cmd);
 		if (supervisor_cmd(w->ctx, &req)) {
 			req.cmd = WDOG_CMD_ERROR;
@@ -139,6 +183,13 @@ static void cmd(uev_t *w, void *arg, int events)
 	close(sd);
 }
 
+static void cmd(uev_t *w, void *arg, int events)
+{
+	lagmon_enter("api", NULL);
+	request(w, arg, events);
+	lagmon_leave();
+}
+
 int api_init(uev_ctx_t *ctx)
 {
 	struct sockaddr_un sun;
@@ -148,6 +199,11 @@ int api_init(uev_ctx_t *ctx)
 		return 1;
 	}
 
+	/* Listening socket from previous instance after upgrade */
+	sd = reexec_api();
+	if (sd != -1)
+		return uev_io_init(ctx, &watcher, cmd, NULL, sd, UEV_READ);
+
 	sun.sun_family = AF_UNIX;
 	if (wdt_testmode())
 		snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", WDOG_SUPERVISOR_TEST);
@@ -189,6 +245,11 @@ int api_exit(void)
 	return 0;
 }
 
+int api_fd(void)
+{
+	return sd;
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
@@ -20,5 +20,6 @@
 
 extern int api_init(uev_ctx_t *ctx);
 extern int api_exit(void);
+extern int api_fd  (void);
 
 #endif /* WDOG_API_H_ */
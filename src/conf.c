@@ -21,6 +21,9 @@
 
 #include "wdt.h"
 #include "rr.h"
+#include "history.h"
+#include "lagmon.h"
+#include "realtime.h"
 #include "script.h"
 #include "monitor.h"
 #include "supervisor.h"
@@ -95,6 +98,32 @@ static int generic_checker(uev_ctx_t *ctx, cfg_t *cfg)
 }
 #endif
 
+#if defined(PROCMON_PLUGIN)
+static int procmon_checker(uev_ctx_t *ctx, cfg_t *cfg)
+{
+	unsigned int i;
+	int rc = 0;
+
+	for (i = 0; i < cfg_size(cfg, "procmon"); i++) {
+		cfg_t *sec = cfg_getnsec(cfg, "procmon", i);
+		int enabled, grace, crit;
+		char *cgroup, *script;
+		const char *name;
+
+		name    = cfg_title(sec);
+		enabled = cfg_getbool(sec, "enabled");
+		grace   = cfg_getint(sec, "grace");
+		crit    = cfg_getbool(sec, "critical");
+		cgroup  = cfg_getstr(sec, "cgroup");
+		script  = cfg_getstr(sec, "script");
+
+		rc += procmon_init(ctx, name, enabled, grace, crit, cgroup, script);
+	}
+
+	return rc;
+}
+#endif
+
 static int wdt_checker(uev_ctx_t *ctx, cfg_t *cfg, const char *sect)
 {
 	unsigned int i;
@@ -103,18 +132,29 @@ static int wdt_checker(uev_ctx_t *ctx, cfg_t *cfg, const char *sect)
 	for (i = 0; i < cfg_size(cfg, sect); i++) {
 		cfg_t *sec = cfg_getnsec(cfg, sect, i);
 		const char *name = cfg_title(sec);
-		int interval, timeout, safe;
+		int interval, timeout, pretmo, reserve, safe, standby;
 
 		interval = cfg_getint(sec, "interval");
 		timeout  = cfg_getint(sec, "timeout");
+		pretmo   = cfg_getint(sec, "pretimeout");
+		reserve  = cfg_getint(sec, "adaptive");
 		safe     = cfg_getbool(sec, "safe-exit");
+		standby  = cfg_getbool(sec, "standby");
 
-		rc += wdt_add(name, interval, timeout, safe, 0);
+		rc += wdt_add(name, interval, timeout, pretmo, reserve, safe, standby, 0);
 	}
 
 	return rc;
 }
 
+static int hotplug(cfg_t *cfg)
+{
+	if (!cfg)
+		return wdt_hotplug(0, NULL);
+
+	return wdt_hotplug(cfg_getbool(cfg, "enabled"), cfg_getstr(cfg, "match"));
+}
+
 static int validate_reset_reason(uev_ctx_t *ctx, cfg_t *cfg)
 {
 	if (!cfg)
@@ -123,6 +163,36 @@ static int validate_reset_reason(uev_ctx_t *ctx, cfg_t *cfg)
 	return reset_reason_init(cfg_getbool(cfg, "enabled"), cfg_getstr(cfg, "file"));
 }
 
+static int statistics(uev_ctx_t *ctx, cfg_t *cfg)
+{
+	if (!cfg)
+		return history_init(ctx, 0, NULL, 0);
+
+	return history_init(ctx, cfg_getbool(cfg, "enabled"), cfg_getstr(cfg, "file"),
+			    cfg_getint(cfg, "interval"));
+}
+
+static int lagmon(uev_ctx_t *ctx, cfg_t *cfg)
+{
+	if (!cfg)
+		return lagmon_init(ctx, 0, 0, 0, 0, NULL);
+
+	return lagmon_init(ctx, cfg_getbool(cfg, "enabled"), cfg_getint(cfg, "interval"),
+			   cfg_getint(cfg, "warning"), cfg_getint(cfg, "critical"),
+			   cfg_getstr(cfg, "script"));
+}
+
+static int realtime(cfg_t *cfg)
+{
+	if (!cfg)
+		return realtime_init(0, 0, 0, NULL, 0, 0, 0);
+
+	return realtime_init(cfg_getbool(cfg, "lock-memory"), cfg_getint(cfg, "stack"),
+			     cfg_getint(cfg, "heap"), cfg_getstr(cfg, "cpus"),
+			     cfg_getbool(cfg, "deadline"), cfg_getint(cfg, "runtime"),
+			     cfg_getint(cfg, "period"));
+}
+
 static int validate_file(cfg_t *cfg, cfg_opt_t *opt)
 {
 	int rc = -1;
@@ -140,12 +210,12 @@ static int validate_file(cfg_t *cfg, cfg_opt_t *opt)
 
 	dir = dirname(tmp);
 	if (file[0] != '/' || !dir) {
-		cfg_error(cfg, "reset-reason backend file must be an absolute path, skipping.");
+		cfg_error(cfg, "%s backend file must be an absolute path, skipping.", cfg_name(cfg));
 		goto done;
 	}
 
 	if (access(dir, R_OK | W_OK)) {
-		cfg_error(cfg, "reset-reason dir '%s' not writable, error %d:%s.", dir, errno, strerror(errno));
+		cfg_error(cfg, "%s dir '%s' not writable, error %d:%s.", cfg_name(cfg), dir, errno, strerror(errno));
 		goto done;
 	}
 
@@ -160,13 +230,19 @@ static int supervisor(uev_ctx_t *ctx, cfg_t *cfg)
 	char *script;
 	int enabled, prio;
 
-	if (!cfg)
+	if (!cfg) {
+		supervisor_warning(0.0, NULL);
+		supervisor_drift(0.0);
 		return supervisor_init(ctx, 0, 0, NULL);
+	}
 
 	enabled = cfg_getbool(cfg, "enabled");
 	prio    = cfg_getint(cfg, "priority");
 	script  = cfg_getstr(cfg, "script");
 
+	supervisor_warning(cfg_getfloat(cfg, "warning"), cfg_getstr(cfg, "warning-script"));
+	supervisor_drift(cfg_getfloat(cfg, "drift"));
+
 	return supervisor_init(ctx, enabled, prio, script);
 }
 
@@ -190,6 +266,172 @@ static int validate_priority(cfg_t *cfg, cfg_opt_t *opt)
 	return 0;
 }
 
+static int validate_warning(cfg_t *cfg, cfg_opt_t *opt)
+{
+	double val = cfg_getfloat(cfg, opt->name);
+
+	if (val < 0.0 || val >= 1.0) {
+		cfg_error(cfg, "supervisor warning '%.2f' must be in range [0.0, 1.0)!", val);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int validate_drift(cfg_t *cfg, cfg_opt_t *opt)
+{
+	double val = cfg_getfloat(cfg, opt->name);
+
+	if (val < 0.0) {
+		cfg_error(cfg, "supervisor drift '%.2f' cannot be negative!", val);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int validate_script(cfg_t *cfg, cfg_opt_t *opt)
+{
+	char *val = cfg_getstr(cfg, opt->name);
+
+	if (val && access(val, X_OK)) {
+		cfg_error(cfg, "supervisor %s '%s' is not executable!", opt->name, val);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Kick interval in msec, plain number is seconds, see wdt_interval() */
+static int parse_interval(cfg_t *cfg, cfg_opt_t *opt, const char *value, void *result)
+{
+	int msec = wdt_interval(value);
+
+	if (msec <= 0) {
+		cfg_error(cfg, "invalid %s '%s', e.g. 10 or 250ms.", opt->name, value);
+		return -1;
+	}
+	*(long *)result = msec;
+
+	return 0;
+}
+
+static int validate_pretimeout(cfg_t *cfg, cfg_opt_t *opt)
+{
+	long val = cfg_getint(cfg, opt->name);
+
+	/* Checked against the driver's timeout in wdt_init() */
+	if (val < 0) {
+		cfg_error(cfg, "pretimeout '%ld' cannot be negative!", val);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int validate_failures(cfg_t *cfg, cfg_opt_t *opt)
+{
+	long val = cfg_getint(cfg, opt->name);
+
+	if (val < 0) {
+		cfg_error(cfg, "kick-failures '%ld' cannot be negative!", val);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int validate_adaptive(cfg_t *cfg, cfg_opt_t *opt)
+{
+	long val = cfg_getint(cfg, opt->name);
+
+	/* Driver reports whole seconds, keep at least one in reserve */
+	if (val != 0 && val < 2) {
+		cfg_error(cfg, "adaptive '%ld' must be 0 (disabled) or at least 2 sec!", val);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int validate_lag(cfg_t *cfg, cfg_opt_t *opt)
+{
+	long val = cfg_getint(cfg, opt->name);
+
+	if (val < 10) {
+		cfg_error(cfg, "lagmon %s '%ld' must be at least 10 ms!", opt->name, val);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int validate_prefault(cfg_t *cfg, cfg_opt_t *opt)
+{
+	long val = cfg_getint(cfg, opt->name);
+	long max = 65536;
+
+	/* Stack is prefaulted with alloca(), stay well below RLIMIT_STACK */
+	if (!strcmp(opt->name, "stack"))
+		max = 1024;
+
+	if (val < 0 || val > max) {
+		cfg_error(cfg, "realtime %s '%ld' must be 0-%ld KiB!", opt->name, val, max);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int validate_dl(cfg_t *cfg, cfg_opt_t *opt)
+{
+	long val = cfg_getint(cfg, opt->name);
+
+	/* Kernel minimum is 1024 nsec, but that is not useful */
+	if (val && (val < 100 || val > 1000000)) {
+		cfg_error(cfg, "realtime %s '%ld' must be 0, or 100-1000000 usec!", opt->name, val);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int validate_cpus(cfg_t *cfg, cfg_opt_t *opt)
+{
+	char *val = cfg_getstr(cfg, opt->name);
+
+	if (val && val[0] && realtime_cpus(val, NULL)) {
+		cfg_error(cfg, "realtime cpus '%s' is not a valid CPU list!", val);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int validate_interval(cfg_t *cfg, cfg_opt_t *opt)
+{
+	long val = cfg_getint(cfg, opt->name);
+
+	if (val < 1) {
+		cfg_error(cfg, "%s interval '%ld' must be at least 1 sec!", cfg_name(cfg), val);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int validate_grace(cfg_t *cfg, cfg_opt_t *opt)
+{
+	long val = cfg_getint(cfg, opt->name);
+
+	if (val < 1) {
+		cfg_error(cfg, "procmon grace '%ld' must be at least 1 sec!", val);
+		return -1;
+	}
+
+	return 0;
+}
+
 static void conf_errfunc(cfg_t *cfg, const char *format, va_list args)
 {
 	char fmt[80];
@@ -210,15 +452,21 @@ static void conf_errfunc(cfg_t *cfg, const char *format, va_list args)
 int conf_parse_file(uev_ctx_t *ctx, char *file)
 {
 	cfg_opt_t device_opts[] =  {
-		CFG_INT ("interval",    WDT_KICK_DEFAULT, CFGF_NONE),
+		CFG_INT_CB("interval",  WDT_KICK_DEFAULT * 1000, CFGF_NONE, parse_interval),
 		CFG_INT ("timeout",     WDT_TIMEOUT_DEFAULT, CFGF_NONE),
+		CFG_INT ("pretimeout",  0, CFGF_NONE),
+		CFG_INT ("adaptive",    0, CFGF_NONE),
 		CFG_BOOL("safe-exit",   cfg_true, CFGF_NONE),
+		CFG_BOOL("standby",     cfg_false, CFGF_NONE),
 		CFG_END()
 	};
 	cfg_opt_t supervisor_opts[] =  {
-		CFG_BOOL("enabled",  cfg_false, CFGF_NONE),
-		CFG_INT ("priority", 0, CFGF_NONE),
-		CFG_STR ("script",   NULL, CFGF_NONE),
+		CFG_BOOL ("enabled",        cfg_false, CFGF_NONE),
+		CFG_INT  ("priority",       0, CFGF_NONE),
+		CFG_STR  ("script",         NULL, CFGF_NONE),
+		CFG_FLOAT("warning",        0.0, CFGF_NONE), /* Disabled by default */
+		CFG_STR  ("warning-script", NULL, CFGF_NONE),
+		CFG_FLOAT("drift",          0.0, CFGF_NONE), /* Disabled by default */
 		CFG_END()
 	};
 	cfg_opt_t reset_reason_opts[] =  {
@@ -226,6 +474,35 @@ int conf_parse_file(uev_ctx_t *ctx, char *file)
 		CFG_STR ("file",     NULL, CFGF_NONE),
 		CFG_END()
 	};
+	cfg_opt_t statistics_opts[] =  {
+		CFG_BOOL("enabled",  cfg_false, CFGF_NONE),
+		CFG_STR ("file",     NULL, CFGF_NONE),
+		CFG_INT ("interval", 300, CFGF_NONE),
+		CFG_END()
+	};
+	cfg_opt_t lagmon_opts[] =  {
+		CFG_BOOL("enabled",  cfg_false, CFGF_NONE),
+		CFG_INT ("interval", 100, CFGF_NONE),  /* msec */
+		CFG_INT ("warning",  250, CFGF_NONE),  /* msec */
+		CFG_INT ("critical", 0, CFGF_NONE),    /* msec, disabled by default */
+		CFG_STR ("script",   NULL, CFGF_NONE),
+		CFG_END()
+	};
+	cfg_opt_t realtime_opts[] =  {
+		CFG_BOOL("lock-memory", cfg_false, CFGF_NONE),
+		CFG_INT ("stack",    64, CFGF_NONE),   /* KiB */
+		CFG_INT ("heap",     1024, CFGF_NONE), /* KiB */
+		CFG_STR ("cpus",     NULL, CFGF_NONE),
+		CFG_BOOL("deadline", cfg_false, CFGF_NONE),
+		CFG_INT ("runtime",  0, CFGF_NONE),    /* usec, 0: derived */
+		CFG_INT ("period",   0, CFGF_NONE),    /* usec, 0: derived */
+		CFG_END()
+	};
+	cfg_opt_t hotplug_opts[] =  {
+		CFG_BOOL("enabled",  cfg_false, CFGF_NONE),
+		CFG_STR ("match",    NULL, CFGF_NONE),
+		CFG_END()
+	};
 	cfg_opt_t checker_opts[] = {
 		CFG_BOOL ("enabled",  cfg_false, CFGF_NONE),
 		CFG_INT  ("interval", 300, CFGF_NONE),
@@ -246,20 +523,37 @@ int conf_parse_file(uev_ctx_t *ctx, char *file)
 		CFG_STR  ("script",         NULL, CFGF_NONE),
 		CFG_END()
 	};
+	cfg_opt_t procmon_opts[] = {
+		CFG_BOOL ("enabled",  cfg_false, CFGF_NONE),
+		CFG_INT  ("grace",    30, CFGF_NONE),
+		CFG_BOOL ("critical", cfg_true, CFGF_NONE),
+		CFG_STR  ("cgroup",   NULL, CFGF_NONE),
+		CFG_STR  ("script",   NULL, CFGF_NONE),
+		CFG_END()
+	};
 	cfg_opt_t opts[] = {
-		CFG_INT ("interval",    WDT_KICK_DEFAULT, CFGF_NONE),
+		CFG_INT_CB("interval",  WDT_KICK_DEFAULT * 1000, CFGF_NONE, parse_interval),
 		CFG_INT ("timeout",     WDT_TIMEOUT_DEFAULT, CFGF_NONE),
+		CFG_INT ("pretimeout",  0, CFGF_NONE),
+		CFG_INT ("adaptive",    0, CFGF_NONE),
 		CFG_BOOL("safe-exit",   cfg_true, CFGF_NONE),
+		CFG_INT ("kick-failures", 0, CFGF_NONE),
+		CFG_BOOL("health-gated", cfg_false, CFGF_NONE),
 		CFG_SEC ("device",      device_opts, CFGF_MULTI | CFGF_TITLE),
+		CFG_SEC ("hotplug",     hotplug_opts, CFGF_NONE),
 		CFG_SEC ("supervisor",  supervisor_opts, CFGF_NONE),
 		CFG_SEC ("reset-cause", reset_reason_opts, CFGF_NONE), /* Compat only */
 		CFG_SEC ("reset-reason", reset_reason_opts, CFGF_NONE),
+		CFG_SEC ("statistics",  statistics_opts, CFGF_NONE),
+		CFG_SEC ("lagmon",      lagmon_opts, CFGF_NONE),
+		CFG_SEC ("realtime",    realtime_opts, CFGF_NONE),
 		CFG_STR ("script",      NULL, CFGF_NONE),
 		CFG_SEC ("filenr",      checker_opts, CFGF_NONE),
 		CFG_SEC ("fsmon",       checker_opts, CFGF_MULTI | CFGF_TITLE),
 		CFG_SEC ("generic",     generic_opts, CFGF_MULTI | CFGF_TITLE),
 		CFG_SEC ("loadavg",     checker_opts, CFGF_NONE),
 		CFG_SEC ("meminfo",     checker_opts, CFGF_NONE),
+		CFG_SEC ("procmon",     procmon_opts, CFGF_MULTI | CFGF_TITLE),
 		CFG_SEC ("tempmon",     checker_opts, CFGF_MULTI | CFGF_TITLE),
 		CFG_END()
 	};
@@ -289,9 +583,27 @@ int conf_parse_file(uev_ctx_t *ctx, char *file)
 	cfg_set_error_function(cfg, conf_errfunc);
 
 	/* Validators */
+	cfg_set_validate_func(cfg, "pretimeout", validate_pretimeout);
+	cfg_set_validate_func(cfg, "device|pretimeout", validate_pretimeout);
+	cfg_set_validate_func(cfg, "adaptive", validate_adaptive);
+	cfg_set_validate_func(cfg, "device|adaptive", validate_adaptive);
+	cfg_set_validate_func(cfg, "kick-failures", validate_failures);
 	cfg_set_validate_func(cfg, "supervisor|priority", validate_priority);
+	cfg_set_validate_func(cfg, "supervisor|warning", validate_warning);
+	cfg_set_validate_func(cfg, "supervisor|drift", validate_drift);
+	cfg_set_validate_func(cfg, "supervisor|warning-script", validate_script);
+	cfg_set_validate_func(cfg, "procmon|grace", validate_grace);
 	cfg_set_validate_func(cfg, "reset-cause|file", validate_file); /* Compat only */
 	cfg_set_validate_func(cfg, "reset-reason|file", validate_file);
+	cfg_set_validate_func(cfg, "statistics|file", validate_file);
+	cfg_set_validate_func(cfg, "statistics|interval", validate_interval);
+	cfg_set_validate_func(cfg, "lagmon|interval", validate_lag);
+	cfg_set_validate_func(cfg, "lagmon|warning", validate_lag);
+	cfg_set_validate_func(cfg, "realtime|stack", validate_prefault);
+	cfg_set_validate_func(cfg, "realtime|heap", validate_prefault);
+	cfg_set_validate_func(cfg, "realtime|cpus", validate_cpus);
+	cfg_set_validate_func(cfg, "realtime|runtime", validate_dl);
+	cfg_set_validate_func(cfg, "realtime|period", validate_dl);
 
 	switch (cfg_parse(cfg, file)) {
 	case CFG_FILE_ERROR:
@@ -313,17 +625,26 @@ int conf_parse_file(uev_ctx_t *ctx, char *file)
 		timeout = cfg_getint(cfg, "timeout");
 	if (!opt_interval)
 		period  = cfg_getint(cfg, "interval");
+	pretimeout = cfg_getint(cfg, "pretimeout");
+	adaptive   = cfg_getint(cfg, "adaptive");
+	kick_failures = cfg_getint(cfg, "kick-failures");
+	health_gated  = cfg_getbool(cfg, "health-gated");
 
 	script_init(ctx, cfg_getstr(cfg, "script"));
+	/* Before supervisor, adopted clients bind their statistics record */
+	statistics(ctx, cfg_getnsec(cfg, "statistics", 0));
 	supervisor(ctx, cfg_getnsec(cfg, "supervisor", 0));
 	opt = cfg_getnsec(cfg, "reset-reason", 0);
 	if (!opt)
 		opt = cfg_getnsec(cfg, "reset-cause", 0); /* Compat only */
 	validate_reset_reason(ctx, opt);
+	lagmon(ctx, cfg_getnsec(cfg, "lagmon", 0));
 
+	hotplug(cfg_getnsec(cfg, "hotplug", 0));
 	wdt_mark();
 	wdt_checker(ctx, cfg, "device");
 	wdt_sweep();
+	realtime(cfg_getnsec(cfg, "realtime", 0));
 
 #ifdef FILENR_PLUGIN
 	checker(ctx, cfg, "filenr", filenr_init);
@@ -344,6 +665,11 @@ int conf_parse_file(uev_ctx_t *ctx, char *file)
 #ifdef MEMINFO_PLUGIN
 	checker(ctx, cfg, "meminfo", meminfo_init);
 #endif
+#ifdef PROCMON_PLUGIN
+	procmon_mark();
+	procmon_checker(ctx, cfg);
+	procmon_sweep();
+#endif
 #ifdef TEMPMON_PLUGIN
 	tempmon_mark();
 	checker(ctx, cfg, "tempmon", tempmon_init);
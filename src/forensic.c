@@ -0,0 +1,223 @@
+/* Forensic snapshot of a stuck supervised process
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Before acting on a missed deadline the supervisor saves a snapshot of
+ * the stuck process next to the reset reason: process and thread state,
+ * wait channel, kernel stack, scheduler statistics, and the last kicks.
+ * The record is plain text and bounded to FORENSIC_MAX bytes, only the
+ * most recent snapshot is kept.
+ */
+
+#include <dirent.h>
+#include <libgen.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include "wdt.h"
+#include "rr.h"
+#include "forensic.h"
+
+#define FORENSIC_MAX     16384
+#define FORENSIC_THREADS 32
+
+static char   buf[FORENSIC_MAX];
+static size_t len;
+
+
+static void append(const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (len >= sizeof(buf) - 1)
+		return;
+
+	va_start(ap, fmt);
+	n = vsnprintf(&buf[len], sizeof(buf) - len, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+
+	len += n;
+	if (len > sizeof(buf) - 1)
+		len = sizeof(buf) - 1;
+}
+
+/* Read a small /proc file, without trailing newlines */
+static char *slurp(const char *path, char *str, size_t sz)
+{
+	ssize_t n;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+
+	n = read(fd, str, sz - 1);
+	close(fd);
+	if (n < 0)
+		return NULL;
+
+	while (n > 0 && str[n - 1] == '\n')
+		n--;
+	str[n] = 0;
+
+	return str;
+}
+
+/* The state follows the command name, which may contain spaces */
+static char state(const char *dir)
+{
+	char path[64], str[512], *ptr;
+
+	snprintf(path, sizeof(path), "%s/stat", dir);
+	if (!slurp(path, str, sizeof(str)))
+		return '?';
+
+	ptr = strrchr(str, ')');
+	if (!ptr || !ptr[1] || !ptr[2])
+		return '?';
+
+	return ptr[2];
+}
+
+static void task(const char *dir, const char *tid)
+{
+	unsigned long long run = 0, delay = 0, slices = 0;
+	char path[64], str[2048], *line;
+
+	snprintf(path, sizeof(path), "%s/wchan", dir);
+	if (!slurp(path, str, sizeof(str)) || !str[0])
+		strlcpy(str, "-", sizeof(str));
+	append("Thread %s, state %c, wchan %s\n", tid, state(dir), str);
+
+	snprintf(path, sizeof(path), "%s/schedstat", dir);
+	if (slurp(path, str, sizeof(str)) &&
+	    sscanf(str, "%llu %llu %llu", &run, &delay, &slices) == 3)
+		append("  run %llu ns, run-delay %llu ns, timeslices %llu\n", run, delay, slices);
+
+	snprintf(path, sizeof(path), "%s/stack", dir);
+	if (!slurp(path, str, sizeof(str)))
+		return;
+
+	for (line = strtok(str, "\n"); line; line = strtok(NULL, "\n"))
+		append("  %s\n", line);
+}
+
+static void tasks(pid_t pid)
+{
+	char path[64], dir[96];
+	struct dirent *d;
+	int num = 0;
+	DIR *dp;
+
+	snprintf(path, sizeof(path), "/proc/%d/task", pid);
+	dp = opendir(path);
+	if (!dp) {
+		append("No threads, %s\n", strerror(errno));
+		return;
+	}
+
+	while ((d = readdir(dp))) {
+		if (d->d_name[0] == '.')
+			continue;
+
+		if (num++ == FORENSIC_THREADS) {
+			append("... more threads not shown\n");
+			break;
+		}
+
+		snprintf(dir, sizeof(dir), "%s/%s", path, d->d_name);
+		task(dir, d->d_name);
+	}
+	closedir(dp);
+}
+
+/* Snapshot is saved in the same directory as the reset reason */
+static char *file(void)
+{
+	static char path[256];
+	const char *rr;
+	char tmp[256];
+
+	rr = reset_reason_path();
+	if (!rr)
+		return NULL;
+
+	strlcpy(tmp, rr, sizeof(tmp));
+	snprintf(path, sizeof(path), "%s/%s", dirname(tmp), WDOG_FORENSICNAME);
+
+	return path;
+}
+
+/*
+ * Called on a missed deadline, before any action is taken.  The @kick
+ * array holds the last @num kick times, oldest first, monotonic msec.
+ */
+int forensic_save(pid_t pid, const char *label, const int64_t *kick, int num)
+{
+	char dir[32], tm[32];
+	int64_t now;
+	time_t t;
+	char *path;
+	int fd, i;
+
+	path = file();
+	if (!path)
+		return 0;
+
+	now = wdt_msec();
+	t = time(NULL);
+	strftime(tm, sizeof(tm), "%Y-%m-%d %H:%M:%S", localtime(&t));
+
+	len = 0;
+	snprintf(dir, sizeof(dir), "/proc/%d", pid);
+	append("Process %s[%d], state %c, missed deadline %s\n", label, pid, state(dir), tm);
+
+	append("Last kicks (msec ago):");
+	if (!num)
+		append(" none");
+	for (i = 0; i < num; i++)
+		append(" %lld", (long long)(now - kick[i]));
+	append("\n");
+
+	tasks(pid);
+
+	/* Kernel stacks, command line and environment, root only */
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd == -1) {
+		PERROR("Failed saving forensic snapshot of %s[%d] to %s", label, pid, path);
+		return -1;
+	}
+	(void)fchmod(fd, 0600);	/* Snapshot from an older version */
+
+	if (write(fd, buf, len) != (ssize_t)len)
+		PERROR("Failed writing forensic snapshot to %s", path);
+	fsync(fd);
+	close(fd);
+
+	LOG("Saved forensic snapshot of %s[%d] in %s", label, pid, path);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ * End:
+ */
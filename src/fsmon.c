@@ -17,6 +17,7 @@
 
 #include <sys/statvfs.h>
 #include "wdt.h"
+#include "lagmon.h"
 #include "script.h"
 
 struct fsmon {
@@ -35,9 +36,8 @@ struct fsmon {
 
 static TAILQ_HEAD(fshead, fsmon) fs = TAILQ_HEAD_INITIALIZER(fs);
 
-static void cb(uev_t *w, void *arg, int events)
+static void check(uev_t *w, struct fsmon *fs)
 {
-	struct fsmon *fs = (struct fsmon *)arg;
 	long long unsigned int bused, fused;
 	float blevel, flevel;
 	struct statvfs f;
@@ -89,6 +89,16 @@ static void cb(uev_t *w, void *arg, int events)
 	}
 }
 
+/* statvfs() may block, e.g., on a hung NFS mount */
+static void cb(uev_t *w, void *arg, int events)
+{
+	struct fsmon *fs = (struct fsmon *)arg;
+
+	lagmon_enter("fsmon", fs->name);
+	check(w, fs);
+	lagmon_leave();
+}
+
 static struct fsmon *find(const char *name)
 {
 	struct fsmon *f;
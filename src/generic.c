@@ -19,6 +19,7 @@
 #include <unistd.h>
 
 #include "wdt.h"
+#include "lagmon.h"
 #include "script.h"
 
 struct generic {
@@ -97,13 +98,8 @@ static int runit(uev_t *w, struct generic *g)
 	return g->pid;
 }
 
-static void cb(uev_t *w, void *arg, int events)
+static void check(uev_t *w, struct generic *g)
 {
-	struct generic *g = (struct generic *)arg;
-
-	if (!g)
-		return;
-
 	if (g->is_running) {
 		EMERG("Timeout reached, script %s is still running, rebooting system ...", g->script);
 		if (checker_exec(g->exec, "generic", 1, 100, g->warning, g->critical))
@@ -122,6 +118,18 @@ static void cb(uev_t *w, void *arg, int events)
 	}
 }
 
+static void cb(uev_t *w, void *arg, int events)
+{
+	struct generic *g = (struct generic *)arg;
+
+	if (!g)
+		return;
+
+	lagmon_enter("generic", g->script);
+	check(w, g);
+	lagmon_leave();
+}
+
 static struct generic *find(const char *script)
 {
 	struct generic *g;
@@ -0,0 +1,72 @@
+/* Log-bucketed histograms for supervisor and WDT statistics
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "hist.h"
+
+/* Highest value that maps to bucket @idx */
+static uint32_t upper(unsigned int idx)
+{
+	unsigned int exp, sub;
+	uint32_t lower;
+
+	if (idx < HIST_SUB)
+		return idx;
+
+	exp   = (idx >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+	sub   = idx & (HIST_SUB - 1);
+	lower = (1U << exp) + (sub << (exp - HIST_SUB_BITS));
+
+	return lower + (1U << (exp - HIST_SUB_BITS)) - 1;
+}
+
+/*
+ * Returns the upper bound of the bucket holding the @pct percentile,
+ * capped by the recorded max value, or zero for an empty histogram.
+ */
+uint32_t hist_percentile(struct hist *h, unsigned int pct)
+{
+	uint64_t rank, sum = 0;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+
+	if (pct > 100)
+		pct = 100;
+
+	rank = ((uint64_t)h->count * pct + 99) / 100;
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		sum += h->bucket[i];
+		if (sum >= rank) {
+			uint32_t val = upper(i);
+
+			return val < h->max ? val : h->max;
+		}
+	}
+
+	return h->max;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ * End:
+ */
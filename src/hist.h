@@ -0,0 +1,79 @@
+/* Log-bucketed histograms for supervisor and WDT statistics
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef WDOG_HIST_H_
+#define WDOG_HIST_H_
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Each power of two is split in 2^HIST_SUB_BITS linear sub-buckets,
+ * giving a worst-case error of 25% with four sub-buckets.  Values up
+ * to 2^HIST_MAX_BITS are tracked, anything above ends up in the last
+ * bucket, the exact maximum is always recorded separately.
+ */
+#define HIST_SUB_BITS   2
+#define HIST_SUB        (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS   24
+#define HIST_BUCKETS    ((HIST_MAX_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+struct hist {
+	uint32_t count;
+	uint32_t max;
+	uint32_t bucket[HIST_BUCKETS];
+};
+
+static inline unsigned int hist_index(uint32_t val)
+{
+	unsigned int exp, idx;
+
+	if (val < HIST_SUB)
+		return val;
+
+	exp = 31 - __builtin_clz(val);
+	idx = ((exp - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+		((val >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1));
+	if (idx >= HIST_BUCKETS)
+		idx = HIST_BUCKETS - 1;
+
+	return idx;
+}
+
+static inline void hist_add(struct hist *h, uint32_t val)
+{
+	h->bucket[hist_index(val)]++;
+	if (val > h->max)
+		h->max = val;
+	h->count++;
+}
+
+static inline void hist_clear(struct hist *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+uint32_t hist_percentile(struct hist *h, unsigned int pct);
+
+#endif /* WDOG_HIST_H_ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ * End:
+ */
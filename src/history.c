@@ -0,0 +1,298 @@
+/* Persistent per-label supervisor statistics
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Long-term statistics per supervised label, kept across restarts and
+ * reboots.  Records are updated in memory by the supervisor, and the
+ * file is rewritten every interval, when dirty, on reset and at exit.
+ * With the default interval of five minutes the disk is written at most
+ * once every five minutes.
+ */
+
+#include <sys/socket.h>
+#include "wdt.h"
+#include "history.h"
+#include "lagmon.h"
+
+#define HISTORY_MAGIC   0x57444f48	/* "WDOH" */
+#define HISTORY_VERSION 1
+#define HISTORY_MAX     64
+
+struct header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+static struct hrec rec[HISTORY_MAX];
+static int    refs[HISTORY_MAX];	/* Supervised processes using record */
+static int    count;
+static int    loaded;
+static int    persist;
+static int    dirty;
+static char  *file;
+static uev_t  watcher;
+
+
+static const char *path(void)
+{
+	if (wdt_testmode())
+		return WDOG_HISTORY_TEST;
+
+	return file ?: WDOG_HISTORY;
+}
+
+static void load(void)
+{
+	struct header hdr;
+	FILE *fp;
+	int i;
+
+	loaded = 1;
+	fp = fopen(path(), "r");
+	if (!fp) {
+		if (errno != ENOENT)
+			PERROR("Failed opening %s", path());
+		return;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.magic != HISTORY_MAGIC ||
+	    hdr.version != HISTORY_VERSION || hdr.count > HISTORY_MAX) {
+		WARN("Invalid statistics file %s, starting over.", path());
+		goto done;
+	}
+
+	count = fread(rec, sizeof(rec[0]), hdr.count, fp);
+	for (i = 0; i < count; i++)
+		rec[i].label[sizeof(rec[i].label) - 1] = 0;
+	DEBUG("Loaded statistics of %d labels from %s", count, path());
+done:
+	fclose(fp);
+}
+
+int history_flush(void)
+{
+	struct header hdr = {
+		.magic   = HISTORY_MAGIC,
+		.version = HISTORY_VERSION,
+	};
+	char tmp[256];
+	FILE *fp;
+	int rc = 0;
+
+	if (!persist)
+		return 0;
+
+	snprintf(tmp, sizeof(tmp), "%s+", path());
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		PERROR("Failed saving statistics to %s", tmp);
+		return -1;
+	}
+
+	hdr.count = count;
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    fwrite(rec, sizeof(rec[0]), count, fp) != (size_t)count)
+		rc = -1;
+	if (fflush(fp) || fsync(fileno(fp)))
+		rc = -1;
+	fclose(fp);
+
+	if (rc || rename(tmp, path())) {
+		PERROR("Failed saving statistics to %s", path());
+		remove(tmp);
+		return -1;
+	}
+	dirty = 0;
+
+	return 0;
+}
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	(void)w;
+	(void)arg;
+	(void)events;
+
+	if (!dirty)
+		return;
+
+	lagmon_enter("statistics", NULL);
+	history_flush();
+	lagmon_leave();
+}
+
+/*
+ * Find, or create, record for @label, release with history_put().  When
+ * the table is full the least recently seen unused label is replaced.
+ */
+struct hrec *history_get(const char *label)
+{
+	struct hrec *r = NULL;
+	int i;
+
+	if (!persist || !label)
+		return NULL;
+
+	for (i = 0; i < count; i++) {
+		if (!strcmp(rec[i].label, label)) {
+			refs[i]++;
+			return &rec[i];
+		}
+	}
+
+	if (count < HISTORY_MAX) {
+		i = count++;
+	} else {
+		int j;
+
+		for (i = -1, j = 0; j < count; j++) {
+			if (refs[j])
+				continue;
+			if (i == -1 || rec[j].last < rec[i].last)
+				i = j;
+		}
+		if (i == -1) {
+			WARN("Statistics table full, not tracking %s", label);
+			return NULL;
+		}
+		DEBUG("Statistics table full, replacing %s with %s", rec[i].label, label);
+	}
+
+	r = &rec[i];
+	memset(r, 0, sizeof(*r));
+	strlcpy(r->label, label, sizeof(r->label));
+	refs[i] = 1;
+	dirty = 1;
+
+	return r;
+}
+
+void history_put(struct hrec *r)
+{
+	if (!r)
+		return;
+
+	if (refs[r - rec] > 0)
+		refs[r - rec]--;
+}
+
+void history_start(struct hrec *r)
+{
+	if (!r)
+		return;
+
+	r->starts++;
+	r->last = time(NULL);
+	dirty = 1;
+}
+
+void history_kick(struct hrec *r, int margin)
+{
+	if (!r)
+		return;
+
+	if (!r->kicks || margin < r->margin)
+		r->margin = margin;
+	r->kicks++;
+	dirty = 1;
+}
+
+void history_near(struct hrec *r)
+{
+	if (!r)
+		return;
+
+	r->near_misses++;
+	r->last = time(NULL);
+	dirty = 1;
+}
+
+void history_miss(struct hrec *r)
+{
+	if (!r)
+		return;
+
+	r->misses++;
+	r->last = time(NULL);
+	dirty = 1;
+}
+
+/* Send one wdog_t per label, same as supervisor_list_clients() */
+int history_list(int sd)
+{
+	wdog_t resp;
+	int i;
+
+	if (!persist)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		memset(&resp, 0, sizeof(resp));
+		resp.cmd = WDOG_HISTORY_CMD;
+		strlcpy(resp.label, rec[i].label, sizeof(resp.label));
+		resp.history.kicks_hi    = WDOG_HI32(rec[i].kicks);
+		resp.history.kicks_lo    = WDOG_LO32(rec[i].kicks);
+		resp.history.starts      = rec[i].starts;
+		resp.history.misses      = rec[i].misses;
+		resp.history.near_misses = rec[i].near_misses;
+		resp.history.margin      = rec[i].margin;
+		resp.history.last        = (unsigned int)rec[i].last;
+
+		if (write(sd, &resp, sizeof(resp)) != sizeof(resp)) {
+			PERROR("Failed sending statistics");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int history_init(uev_ctx_t *ctx, int ena, char *fn, int interval)
+{
+	if (persist)
+		uev_timer_stop(&watcher);
+
+	if (file) {
+		free(file);
+		file = NULL;
+	}
+	if (fn)
+		file = strdup(fn);
+
+	persist = ena;
+	if (!persist) {
+		/* Records are kept in memory, in case we're re-enabled */
+		return 0;
+	}
+
+	/* Only loaded once, records are referenced by the supervisor */
+	if (!loaded)
+		load();
+
+	INFO("Saving supervisor statistics to %s every %d sec.", path(), interval);
+
+	return uev_timer_init(ctx, &watcher, cb, NULL, interval * 1000, interval * 1000);
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ * End:
+ */
@@ -0,0 +1,53 @@
+/* Persistent per-label supervisor statistics
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef WDOG_HISTORY_H_
+#define WDOG_HISTORY_H_
+
+#include <stdint.h>
+#include <uev/uev.h>
+
+struct hrec {
+	char     label[48];
+	uint64_t kicks;
+	uint32_t starts;	/* Number of subscriptions */
+	uint32_t misses;	/* Failures, e.g., missed deadlines */
+	uint32_t near_misses;	/* Soft deadlines crossed */
+	int32_t  margin;	/* Lowest time left at kick, msec */
+	int64_t  last;		/* Last seen, wall clock */
+};
+
+int          history_init  (uev_ctx_t *ctx, int enabled, char *file, int interval);
+int          history_flush (void);
+int          history_list  (int sd);
+
+struct hrec *history_get   (const char *label);
+void         history_put   (struct hrec *r);
+
+void         history_start (struct hrec *r);
+void         history_kick  (struct hrec *r, int margin);
+void         history_near  (struct hrec *r);
+void         history_miss  (struct hrec *r);
+
+#endif /* WDOG_HISTORY_H_ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ * End:
+ */
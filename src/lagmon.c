@@ -0,0 +1,157 @@
+/* Event loop lag monitor
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * A high-frequency timer measures how late the event loop services it.
+ * Any callback that blocks, e.g., statvfs() on a hung NFS mount, a big
+ * .conf reload, or a slow client, delays the WDT kicks just as much.
+ * Callbacks at risk are bracketed by lagmon_enter() and lagmon_leave(),
+ * the slowest one since the last probe is named as the offender.
+ */
+
+#include "wdt.h"
+#include "lagmon.h"
+#include "script.h"
+
+static uev_t   watcher;
+static int     running;
+static int     interval;		/* msec */
+static int     warning;		/* msec */
+static int     critical;		/* msec, 0: disabled */
+static char   *exec;
+
+static int64_t next;			/* usec, probe deadline */
+
+static const char *cur_name;		/* Callback currently running */
+static const char *cur_detail;
+static int64_t start;
+
+static char    culprit[48];		/* Slowest callback since last probe */
+static int64_t culprit_len;		/* usec */
+
+void lagmon_enter(const char *name, const char *detail)
+{
+	cur_name   = name;
+	cur_detail = detail;
+	start      = wdt_usec();
+}
+
+void lagmon_leave(void)
+{
+	int64_t len;
+
+	if (!cur_name)
+		return;
+
+	len = wdt_usec() - start;
+	if (running && len > culprit_len) {
+		if (cur_detail)
+			snprintf(culprit, sizeof(culprit), "%s %s", cur_name, cur_detail);
+		else
+			strlcpy(culprit, cur_name, sizeof(culprit));
+		culprit_len = len;
+	}
+	cur_name = NULL;
+}
+
+static void report(uev_ctx_t *ctx, int lag)
+{
+	const char *who = "unknown callback";
+
+	/* Only blame a callback that accounts for the lag */
+	if (culprit_len >= (int64_t)warning * 1000)
+		who = culprit;
+	setenv("LAGMON_NAME", who, 1);
+
+	if (critical && lag >= critical) {
+		wdog_reason_t reason;
+
+		EMERG("Event loop blocked %d ms by %s, rebooting system ...", lag, who);
+		if (checker_exec(exec, "lagmon", 1, lag, warning, critical)) {
+			memset(&reason, 0, sizeof(reason));
+			reason.code = WDOG_CPU_OVERLOAD;
+			snprintf(reason.label, sizeof(reason.label), "%s:%s", PACKAGE, who);
+			wdt_reset(ctx, getpid(), &reason, 0);
+		}
+		unsetenv("LAGMON_NAME");
+		return;
+	}
+
+	WARN("Event loop blocked %d ms by %s, WDT kicks delayed!", lag, who);
+	checker_exec(exec, "lagmon", 0, lag, warning, critical);
+	unsetenv("LAGMON_NAME");
+}
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	int64_t now, lag, T;
+
+	now = wdt_usec();
+	lag = now - next;
+	DEBUG("Event loop lag %lld usec", (long long)lag);
+
+	/* Next probe, skip any deadlines already passed */
+	T = (int64_t)interval * 1000;
+	next += T;
+	if (next <= now)
+		next += ((now - next) / T + 1) * T;
+	uev_timer_set(w, (int)((next - now + 999) / 1000), 0);
+
+	if (lag >= (int64_t)warning * 1000)
+		report(w->ctx, (int)(lag / 1000));
+
+	culprit_len = 0;
+	culprit[0]  = 0;
+}
+
+int lagmon_init(uev_ctx_t *ctx, int enabled, int T, int warn, int crit, char *script)
+{
+	if (exec) {
+		free(exec);
+		exec = NULL;
+	}
+	if (script)
+		exec = strdup(script);
+
+	warning  = warn;
+	critical = crit;
+
+	if (!enabled) {
+		INFO("Event loop lag monitor disabled.");
+		running = 0;
+		return uev_timer_stop(&watcher);
+	}
+
+	/* On reload, keep probing so we measure the reload itself */
+	if (running && T == interval)
+		return 0;
+
+	INFO("Event loop lag monitor, period %d ms, warning: %d ms, reboot: %d ms", T, warn, crit);
+	interval = T;
+	running  = 1;
+	next     = wdt_usec() + (int64_t)T * 1000;
+
+	uev_timer_stop(&watcher);
+	return uev_timer_init(ctx, &watcher, cb, NULL, T, 0);
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ * End:
+ */
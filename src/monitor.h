@@ -31,6 +31,10 @@ int  generic_init (uev_ctx_t* ctx, const char *name, int T, int timeout, int war
 void generic_mark (void);
 void generic_sweep(void);
 
+int  procmon_init (uev_ctx_t *ctx, const char *name, int enabled, int grace, int crit, char *cgroup, char *script);
+void procmon_mark (void);
+void procmon_sweep(void);
+
 int  tempmon_init (uev_ctx_t *ctx, const char *path, int T, int mark, float warn, float crit, char *script);
 void tempmon_mark (void);
 void tempmon_sweep(void);
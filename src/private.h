@@ -19,12 +19,18 @@
 #define WDOG_PRIVATE_H_
 
 #include <paths.h>
+#include <sched.h>
 #include <unistd.h>
+#include "wdog.h"
 
 #ifndef _PATH_PRESERVE
 #define _PATH_PRESERVE              "/var/lib"
 #endif
 
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE              6 /* Linux 3.14, missing in older C libraries */
+#endif
+
 #define WDOG_RESET_STR_DEFAULT      "*RESET*"
 
 #define WDOG_STATEDIR               _PATH_PRESERVE "/misc/"
@@ -39,10 +45,20 @@
 #define WDOG_STATE                  WDOG_STATEDIR  WDOG_STATENAME
 #define WDOG_STATE_TEST             WDOG_TESTDIR   WDOG_STATENAME
 
+#define WDOG_FORENSICNAME           "watchdogd.forensic"
+
+#define WDOG_HISTORYNAME            "watchdogd.stats"
+#define WDOG_HISTORY                WDOG_STATEDIR  WDOG_HISTORYNAME
+#define WDOG_HISTORY_TEST           WDOG_TESTDIR   WDOG_HISTORYNAME
+
 #define WDOG_STATUSNAME             "status"
 #define WDOG_STATUS                 WDOG_STATUSDIR WDOG_STATUSNAME
 #define WDOG_STATUS_TEST            WDOG_TESTDIR   WDOG_STATUSNAME
 
+#define WDOG_CLIENTSNAME            "clients"
+#define WDOG_CLIENTS                WDOG_STATUSDIR WDOG_CLIENTSNAME
+#define WDOG_CLIENTS_TEST           WDOG_TESTDIR   WDOG_CLIENTSNAME
+
 #define WDOG_PIDFILE                WDOG_STATUSDIR "pid"
 
 #define WDOG_SUBSCRIBE_CMD          1
@@ -72,10 +88,32 @@
 #define WDOG_FAILED_MEMLEAK_CMD     29
 #define WDOG_FAILED_OVERLOAD_CMD    30
 #define WDOG_LIST_SUPV_CLIENTS_CMD  31
+#define WDOG_CLIENT_STATS_CMD       32
+#define WDOG_UPGRADE_CMD            33
+#define WDOG_THROUGHPUT_CMD         34
+#define WDOG_LATENCY_CMD            35
+#define WDOG_STAGE_CMD              36
+#define WDOG_CHECKPOINT_CMD         37
+#define WDOG_JOIN_CMD               38
+#define WDOG_FAILED_CODE_CMD        39 /* Codes after overload, code in error */
+#define WDOG_HISTORY_CMD            40
+#define WDOG_DEVICES_CMD            41
+#define WDOG_REALTIME_CMD           42
 #define WDOG_CMD_ERROR              -1
 
 #define WDOG_SUPERVISOR_MIN_TIMEOUT 1000 /* msec */
 
+#define WDOG_KICK_WORK              0x01 /* kick.work is valid */
+#define WDOG_KICK_LATENCY           0x02 /* kick.sample[] is valid */
+
+/*
+ * 64-bit counters are sent as two 32-bit halves to keep the union
+ * 4-byte aligned, sizeof(wdog_t) is part of the wire ABI.
+ */
+#define WDOG_HI32(v)                ((unsigned int)((unsigned long long)(v) >> 32))
+#define WDOG_LO32(v)                ((unsigned int)((unsigned long long)(v) & 0xffffffffU))
+#define WDOG_U64(hi, lo)            (((unsigned long long)(hi) << 32) | (lo))
+
 typedef struct {
 	int          cmd;
 	int          error;	/* Set on WDOG_CMD_ERROR */
@@ -85,9 +123,108 @@ typedef struct {
 	unsigned int ack;
 	unsigned int next_ack;
 	char         label[48];	/* process name or label */
-	char         padding[128];
+	union {
+		char padding[128];
+
+		/* WDOG_KICK_CMD, optional progress report */
+		struct {
+			unsigned int flags;	/* WDOG_KICK_* */
+			unsigned int work;	/* Work counter, may wrap */
+			unsigned int count;	/* Number of samples */
+			unsigned int sample[WDOG_LATENCY_SAMPLES]; /* usec */
+		} kick;
+
+		/* WDOG_THROUGHPUT_CMD, rate 0 disables */
+		struct {
+			unsigned int rate;	/* Min. work per second */
+			unsigned int window;	/* msec */
+		} floor;
+
+		/* WDOG_LATENCY_CMD, budget 0 disables */
+		struct {
+			unsigned int budget;	/* Max p99 loop latency, usec */
+			unsigned int window;	/* msec */
+			unsigned int periods;	/* Consecutive windows before action */
+		} slo;
+
+		/* WDOG_STAGE_CMD and WDOG_CHECKPOINT_CMD */
+		struct {
+			int          index;	/* Stage index, in reply to STAGE */
+			unsigned int budget;	/* msec */
+			char         name[WDOG_STAGE_NAMELEN];
+		} stage;
+
+		/* WDOG_JOIN_CMD */
+		struct {
+			unsigned int quorum;	/* Min. number of live members */
+			char         name[WDOG_GROUP_NAMELEN];
+		} group;
+
+		/* WDOG_CLIENT_STATS_CMD reply, all times in msec */
+		struct {
+			unsigned int kicks;
+			unsigned int p50;	/* Kick interval percentiles */
+			unsigned int p99;
+			unsigned int max;
+			int          margin;	/* Lowest time left at kick */
+			unsigned int near_miss;	/* Soft deadlines crossed */
+			unsigned int rate;	/* Work/sec, last window */
+			unsigned int latency;	/* p99 usec, last window */
+			unsigned int drifts;	/* Kick cadence drifts */
+		} stats;
+
+		/* WDOG_HISTORY_CMD reply, one per label */
+		struct {
+			unsigned int kicks_hi;
+			unsigned int kicks_lo;
+			unsigned int starts;
+			unsigned int misses;
+			unsigned int near_misses;
+			int          margin;	/* msec */
+			unsigned int last;	/* Last seen, UNIX time */
+		} history;
+
+		/* WDOG_DEVICES_CMD reply, one per WDT, name in label */
+		struct {
+			unsigned int timeout;	/* msec */
+			unsigned int interval;	/* msec */
+			int          timeleft;	/* sec, last read, or -1 */
+			int          margin;	/* sec, lowest time left, or -1 */
+			int          adaptive;	/* sec, 0: disabled */
+			unsigned int kicks;	/* Kick timer wakeups */
+			unsigned int p50;	/* Lateness percentiles, usec */
+			unsigned int p99;
+			unsigned int max;
+			unsigned int failures;	/* Failed kicks */
+			unsigned int lat_p99;	/* Kick ioctl latency, usec */
+			unsigned int lat_max;
+			int          standby;	/* Waiting for failover */
+		} device;
+
+		/* WDOG_REALTIME_CMD reply, CPU affinity in label */
+		struct {
+			int          policy;	/* SCHED_* */
+			int          priority;
+			int          locked;	/* mlockall() active */
+			unsigned int stack;	/* KiB prefaulted */
+			unsigned int heap;	/* KiB prefaulted */
+			unsigned int minflt_hi;
+			unsigned int minflt_lo;
+			unsigned int majflt_hi;
+			unsigned int majflt_lo;
+			unsigned int minflt_locked_hi; /* Since prefault */
+			unsigned int minflt_locked_lo;
+			unsigned int majflt_locked_hi;
+			unsigned int majflt_locked_lo;
+			unsigned int runtime;	/* SCHED_DEADLINE, usec */
+			unsigned int deadline;
+			unsigned int period;
+		} rt;
+	};
 } wdog_t;
 
+_Static_assert(sizeof(wdog_t) == 204, "wdog_t size is part of the wire ABI");
+
 #endif /* WDOG_PRIVATE_H_ */
 
 /**
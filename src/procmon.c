@@ -0,0 +1,458 @@
+/* Process monitor for non-cooperating processes, netlink proc connector
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Processes that cannot be modified to use libwdog are tracked by name,
+ * and optionally cgroup, using exec and exit events from the kernel's
+ * process connector.  /proc is only read once at startup, to find the
+ * processes already running, and on exec events to match the name.
+ * Matching children forked by a tracked process are also tracked, so a
+ * daemon that detaches by forking and letting its parent exit is not
+ * lost.  A tracked process that execs another program is dropped.
+ *
+ * When the last tracked process of an entry exits, or no matching
+ * process has appeared at startup, a grace timer is started.  If no
+ * matching process has (re)appeared when it expires, e.g., restarted by
+ * init, the script is called, or the system is reset.
+ */
+
+#include <dirent.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+#include "wdt.h"
+#include "script.h"
+
+#define PROCMON_PIDS 16			/* Max tracked PIDs per entry */
+
+struct procmon {
+	TAILQ_ENTRY(procmon) link; /* BSD sys/queue.h linked list node. */
+
+	char  *name;		/* comm, or '*' for any */
+	char  *cgroup;		/* Optional cgroup path, substring match */
+	int    grace;		/* sec, at least 1 */
+	int    critical;	/* Reset on failure, or just warn */
+	char  *exec;
+	int    enabled;
+
+	pid_t  pid[PROCMON_PIDS];
+	int    num;
+
+	uev_t  watcher;		/* Grace timer */
+	int    dirty;		/* for mark & sweep */
+};
+
+static TAILQ_HEAD(pmhead, procmon) pms = TAILQ_HEAD_INITIALIZER(pms);
+
+static uev_t nlw;
+static int   sd = -1;
+
+
+static int send_op(int op)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct cn_msg   cn;
+		uint32_t        op;
+	} __attribute__((packed)) msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.nlh.nlmsg_len  = sizeof(msg);
+	msg.nlh.nlmsg_type = NLMSG_DONE;
+	msg.nlh.nlmsg_pid  = getpid();
+	msg.cn.id.idx      = CN_IDX_PROC;
+	msg.cn.id.val      = CN_VAL_PROC;
+	msg.cn.len         = sizeof(uint32_t);
+	msg.op             = op;
+
+	if (send(sd, &msg, sizeof(msg), 0) != sizeof(msg))
+		return -1;
+
+	return 0;
+}
+
+static int match(struct procmon *pm, pid_t pid)
+{
+	char path[32], buf[512];
+	ssize_t len;
+	int fd;
+
+	if (strcmp(pm->name, "*")) {
+		snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+			return 0;
+		len = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (len <= 0)
+			return 0;
+		buf[len] = 0;
+		chomp(buf);
+
+		if (strcmp(buf, pm->name))
+			return 0;
+	}
+
+	if (pm->cgroup) {
+		snprintf(path, sizeof(path), "/proc/%d/cgroup", pid);
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+			return 0;
+		len = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (len <= 0)
+			return 0;
+		buf[len] = 0;
+
+		if (!strstr(buf, pm->cgroup))
+			return 0;
+	}
+
+	return 1;
+}
+
+static int tracked(struct procmon *pm, pid_t pid)
+{
+	int i;
+
+	for (i = 0; i < pm->num; i++) {
+		if (pm->pid[i] == pid)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void track(struct procmon *pm, pid_t pid)
+{
+	if (tracked(pm, pid))
+		return;
+
+	if (pm->num == PROCMON_PIDS) {
+		DEBUG("Procmon %s: too many processes, not tracking %d.", pm->name, pid);
+		return;
+	}
+
+	if (!pm->num) {
+		uev_timer_stop(&pm->watcher);
+		INFO("Procmon %s: running, PID %d.", pm->name, pid);
+	}
+	pm->pid[pm->num++] = pid;
+}
+
+static void fail(uev_ctx_t *ctx, struct procmon *pm, pid_t pid)
+{
+	char label[48], val[12];
+
+	if (pm->critical)
+		EMERG("Procmon %s: not running, rebooting system ...", pm->name);
+	else
+		WARN("Procmon %s: not running.", pm->name);
+
+	snprintf(val, sizeof(val), "%d", pid);
+	setenv("PROCMON_PID", val, 1);
+	setenv("PROCMON_NAME", pm->name, 1);
+	if (checker_exec(pm->exec, "procmon", pm->critical, 0.0, 0.0, 0.0) && pm->critical) {
+		snprintf(label, sizeof(label), PACKAGE ":%s", pm->name);
+		wdt_forced_reset(ctx, pid, label, 0);
+	}
+	unsetenv("PROCMON_PID");
+	unsetenv("PROCMON_NAME");
+}
+
+/* Grace period expired and still no matching process */
+static void grace_cb(uev_t *w, void *arg, int events)
+{
+	struct procmon *pm = (struct procmon *)arg;
+
+	if (pm->num)
+		return;
+
+	fail(w->ctx, pm, 0);
+}
+
+static void lost(uev_ctx_t *ctx, struct procmon *pm, pid_t pid)
+{
+	int i;
+
+	for (i = 0; i < pm->num; i++) {
+		if (pm->pid[i] == pid)
+			break;
+	}
+
+	if (i == pm->num)
+		return;
+
+	pm->pid[i] = pm->pid[--pm->num];
+	if (pm->num || !pm->enabled)
+		return;
+
+	WARN("Procmon %s: PID %d exited, waiting %d sec for it to restart.", pm->name, pid, pm->grace);
+	uev_timer_set(&pm->watcher, pm->grace * 1000, 0);
+}
+
+static void event(uev_ctx_t *ctx, struct proc_event *ev)
+{
+	struct procmon *pm;
+
+	switch (ev->what) {
+	case PROC_EVENT_FORK:
+		/* New process, not thread, e.g. a daemon detaching itself */
+		if (ev->event_data.fork.child_pid != ev->event_data.fork.child_tgid)
+			break;
+
+		TAILQ_FOREACH(pm, &pms, link) {
+			if (pm->enabled && tracked(pm, ev->event_data.fork.parent_tgid) &&
+			    match(pm, ev->event_data.fork.child_pid))
+				track(pm, ev->event_data.fork.child_pid);
+		}
+		break;
+
+	case PROC_EVENT_EXEC:
+		if (ev->event_data.exec.process_pid != ev->event_data.exec.process_tgid)
+			break;
+
+		TAILQ_FOREACH(pm, &pms, link) {
+			if (!pm->enabled)
+				continue;
+
+			/* Tracked process may exec another program, e.g. sh -c */
+			if (match(pm, ev->event_data.exec.process_pid))
+				track(pm, ev->event_data.exec.process_pid);
+			else
+				lost(ctx, pm, ev->event_data.exec.process_pid);
+		}
+		break;
+
+	case PROC_EVENT_EXIT:
+		if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid)
+			break;
+
+		TAILQ_FOREACH(pm, &pms, link)
+			lost(ctx, pm, ev->event_data.exit.process_pid);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	char buf[4096] __attribute__((aligned(NLMSG_ALIGNTO)));
+	struct nlmsghdr *nlh;
+	ssize_t len;
+
+	while ((len = recv(w->fd, buf, sizeof(buf), 0)) > 0) {
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (size_t)len); nlh = NLMSG_NEXT(nlh, len)) {
+			struct cn_msg *cn;
+
+			if (nlh->nlmsg_type == NLMSG_ERROR || nlh->nlmsg_type == NLMSG_NOOP)
+				continue;
+
+			cn = NLMSG_DATA(nlh);
+			if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC)
+				continue;
+
+			event(w->ctx, (struct proc_event *)cn->data);
+		}
+	}
+
+	if (len == -1 && errno == ENOBUFS)
+		WARN("Procmon: lost process events, kernel buffer overrun.");
+}
+
+static int open_nl(uev_ctx_t *ctx)
+{
+	struct sockaddr_nl sa = { 0 };
+
+	if (sd != -1)
+		return 0;
+
+	sd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+	if (sd == -1) {
+		PERROR("Procmon: failed opening process connector");
+		return -1;
+	}
+
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = CN_IDX_PROC;
+	sa.nl_pid    = getpid();
+	if (bind(sd, (struct sockaddr *)&sa, sizeof(sa)) || send_op(PROC_CN_MCAST_LISTEN)) {
+		PERROR("Procmon: failed subscribing to process events");
+		goto err;
+	}
+
+	if (uev_io_init(ctx, &nlw, cb, NULL, sd, UEV_READ)) {
+		PERROR("Procmon: failed watching process connector");
+		goto err;
+	}
+
+	return 0;
+err:
+	close(sd);
+	sd = -1;
+	return -1;
+}
+
+static void close_nl(void)
+{
+	if (sd == -1)
+		return;
+
+	send_op(PROC_CN_MCAST_IGNORE);
+	uev_io_stop(&nlw);
+	close(sd);
+	sd = -1;
+}
+
+/* Find processes already running, only done at (re)init */
+static void scan(struct procmon *pm)
+{
+	struct dirent *d;
+	DIR *dp;
+
+	dp = opendir("/proc");
+	if (!dp)
+		return;
+
+	while ((d = readdir(dp))) {
+		pid_t pid;
+
+		if (!isdigit(d->d_name[0]))
+			continue;
+
+		pid = atoi(d->d_name);
+		if (match(pm, pid))
+			track(pm, pid);
+	}
+	closedir(dp);
+}
+
+static struct procmon *find(const char *name)
+{
+	struct procmon *pm;
+
+	TAILQ_FOREACH(pm, &pms, link) {
+		if (strcmp(pm->name, name))
+			continue;
+
+		return pm;
+	}
+
+	return NULL;
+}
+
+void procmon_mark(void)
+{
+	struct procmon *pm;
+
+	TAILQ_FOREACH(pm, &pms, link) {
+		pm->dirty = 1;
+	}
+}
+
+void procmon_sweep(void)
+{
+	struct procmon *pm, *tmp;
+	int active = 0;
+
+	TAILQ_FOREACH_SAFE(pm, &pms, link, tmp) {
+		if (!pm->dirty) {
+			active += pm->enabled;
+			continue;
+		}
+
+		TAILQ_REMOVE(&pms, pm, link);
+		uev_timer_stop(&pm->watcher);
+		free(pm->name);
+		if (pm->cgroup)
+			free(pm->cgroup);
+		if (pm->exec)
+			free(pm->exec);
+		free(pm);
+	}
+
+	if (!active)
+		close_nl();
+}
+
+int procmon_init(uev_ctx_t *ctx, const char *name, int enabled, int grace, int crit, char *cgroup, char *script)
+{
+	struct procmon *pm;
+
+	pm = find(name);
+	if (!pm) {
+		pm = calloc(1, sizeof(*pm));
+		if (!pm) {
+		fail:
+			PERROR("Failed initializing procmon plugin");
+			return 1;
+		}
+
+		pm->name = strdup(name);
+		if (!pm->name) {
+			free(pm);
+			goto fail;
+		}
+
+		uev_timer_init(ctx, &pm->watcher, grace_cb, pm, 0, 0);
+		TAILQ_INSERT_TAIL(&pms, pm, link);
+	} else {
+		pm->dirty = 0;
+		uev_timer_stop(&pm->watcher);
+		if (pm->cgroup)
+			free(pm->cgroup);
+		if (pm->exec)
+			free(pm->exec);
+	}
+
+	pm->enabled  = enabled;
+	pm->grace    = grace;
+	pm->critical = crit;
+	pm->cgroup   = cgroup ? strdup(cgroup) : NULL;
+	pm->exec     = script ? strdup(script) : NULL;
+	pm->num      = 0;
+
+	if (!enabled) {
+		INFO("Procmon %s disabled.", pm->name);
+		return 0;
+	}
+
+	if (open_nl(ctx))
+		return 1;
+
+	INFO("Procmon %s%s%s, grace %d sec, %s.", pm->name, cgroup ? " in cgroup " : "",
+	     cgroup ?: "", grace, crit ? "critical" : "warning only");
+
+	scan(pm);
+	if (!pm->num) {
+		WARN("Procmon %s: not running, waiting %d sec for it to start.", pm->name, grace);
+		uev_timer_set(&pm->watcher, grace * 1000, 0);
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ * End:
+ */
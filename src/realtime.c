@@ -0,0 +1,507 @@
+/* Real-time hardening, memory locking and CPU affinity
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * SCHED_RR only bounds the latency to the CPU, the daemon may still
+ * stall on a page fault in its heap, or in libc, at the worst possible
+ * moment, e.g., when the host is under memory pressure.  Locking all
+ * current and future pages in RAM, and prefaulting stack and heap, the
+ * kick latency is bounded by scheduling alone.  The page fault counters
+ * are available with `watchdogctl realtime` to verify the result.
+ *
+ * With SCHED_DEADLINE the daemon is guaranteed a CPU budget (runtime)
+ * every period, even if higher priority RT tasks misbehave.  Unless
+ * set in the .conf, the period is derived from the shortest WDT kick
+ * interval and client timeout, and the runtime from the number of
+ * client kicks per period.  If the kernel refuses, e.g., no privileges,
+ * restricted CPU affinity, or admission control, we fall back to the
+ * SCHED_RR priority requested by the process supervisor.
+ */
+
+#include <alloca.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "wdt.h"
+#include "realtime.h"
+#include "supervisor.h"
+
+#ifndef SCHED_FLAG_RESET_ON_FORK
+#define SCHED_FLAG_RESET_ON_FORK 0x01
+#endif
+
+#define DL_PERIOD_MIN    1000		/* usec */
+#define DL_PERIOD_MAX  100000
+#define DL_RUNTIME_BASE  1000		/* Kick WDTs, timers, and API */
+#define DL_RUNTIME_KICK    50		/* Per client kick */
+
+/* Not in all C libraries, see sched_setattr(2) */
+struct dlattr {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t  sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;		/* nsec */
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+};
+
+static int     locked;
+static size_t  stack_kib;		/* Prefaulted so far */
+static size_t  heap_kib;
+
+static long    minflt;			/* Page faults when memory was locked */
+static long    majflt;
+
+static int     pinned;
+static cpu_set_t orig;			/* Affinity before pinning */
+
+static int     rtprio;			/* From supervisor, 0: SCHED_OTHER */
+static int     deadline;		/* SCHED_DEADLINE requested */
+static int     dl_active;
+static int     dl_failed;		/* Refused, until next .conf reload */
+static unsigned int dl_runtime;		/* usec, from .conf, 0: derived */
+static unsigned int dl_period;
+static unsigned int cur_runtime;	/* usec, in effect */
+static unsigned int cur_period;
+
+
+/* Touch one byte per page, without the compiler optimizing it away */
+static void touch(volatile char *buf, size_t len)
+{
+	long pgsz = sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	for (i = 0; i < len; i += pgsz)
+		buf[i] = 0;
+}
+
+static __attribute__((noinline)) void prefault_stack(size_t kib)
+{
+	size_t len = kib * 1024;
+
+	touch(alloca(len), len);
+}
+
+/*
+ * Disable heap trimming and mmap() for large allocations, then grow
+ * the heap and release the memory to the allocator.  The pages stay
+ * mapped, and locked, for future allocations.
+ */
+static int prefault_heap(size_t kib)
+{
+	size_t len = kib * 1024;
+	char *buf;
+
+	/* GNU extensions, not available in musl libc */
+#ifdef M_TRIM_THRESHOLD
+	mallopt(M_TRIM_THRESHOLD, -1);
+#endif
+#ifdef M_MMAP_MAX
+	mallopt(M_MMAP_MAX, 0);
+#endif
+
+	buf = malloc(len);
+	if (!buf)
+		return -1;
+
+	touch(buf, len);
+	free(buf);
+
+	return 0;
+}
+
+static void faults(long *min, long *maj)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru)) {
+		*min = *maj = 0;
+		return;
+	}
+
+	*min = ru.ru_minflt;
+	*maj = ru.ru_majflt;
+}
+
+static int lock(size_t stack, size_t heap)
+{
+	int prefault = 0;
+
+	if (!locked) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+			if (!wdt_testmode())
+				PERROR("Failed locking memory, check RLIMIT_MEMLOCK");
+			return -1;
+		}
+		locked = prefault = 1;
+	}
+
+	/* Only ever grow, memory is not given back to the kernel */
+	if (stack > stack_kib) {
+		prefault_stack(stack);
+		stack_kib = stack;
+		prefault = 1;
+	}
+	if (heap > heap_kib) {
+		if (prefault_heap(heap))
+			PERROR("Failed prefaulting %zu KiB heap", heap);
+		else
+			heap_kib = heap;
+		prefault = 1;
+	}
+
+	/* Any page faults after this point are unexpected */
+	if (prefault) {
+		faults(&minflt, &majflt);
+		INFO("Memory locked, prefaulted %zu KiB stack, %zu KiB heap, "
+		     "%ld minor and %ld major page faults since start.",
+		     stack_kib, heap_kib, minflt, majflt);
+	}
+
+	return 0;
+}
+
+static void unlock(void)
+{
+	if (!locked)
+		return;
+
+	if (munlockall())
+		PERROR("Failed unlocking memory");
+	locked = 0;
+	INFO("Memory no longer locked.");
+}
+
+/*
+ * Parse a CPU list, e.g., "0", "0-1", or "0,2-3".  Returns 0 if @str is
+ * a valid list, -1 otherwise.  The @set is optional.
+ */
+int realtime_cpus(const char *str, cpu_set_t *set)
+{
+	const char *ptr = str;
+	cpu_set_t tmp;
+
+	CPU_ZERO(&tmp);
+	while (*ptr) {
+		char *end;
+		long lo, hi;
+
+		lo = strtol(ptr, &end, 10);
+		if (end == ptr || lo < 0)
+			return -1;
+		hi = lo;
+		if (*end == '-') {
+			ptr = end + 1;
+			hi = strtol(ptr, &end, 10);
+			if (end == ptr || hi < lo)
+				return -1;
+		}
+		if (hi >= CPU_SETSIZE)
+			return -1;
+
+		while (lo <= hi)
+			CPU_SET(lo++, &tmp);
+
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return -1;
+		ptr = end;
+	}
+
+	if (!CPU_COUNT(&tmp))
+		return -1;
+	if (set)
+		*set = tmp;
+
+	return 0;
+}
+
+static int pin(const char *cpus)
+{
+	cpu_set_t set;
+
+	if (!cpus || !cpus[0]) {
+		if (pinned && sched_setaffinity(0, sizeof(orig), &orig))
+			PERROR("Failed restoring CPU affinity");
+		pinned = 0;
+		return 0;
+	}
+
+	if (realtime_cpus(cpus, &set)) {
+		ERROR("Invalid CPU list '%s'", cpus);
+		return -1;
+	}
+
+	if (!pinned && sched_getaffinity(0, sizeof(orig), &orig)) {
+		PERROR("Failed reading CPU affinity");
+		return -1;
+	}
+
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		PERROR("Failed pinning to CPU(s) %s", cpus);
+		return -1;
+	}
+	pinned = 1;
+	INFO("Pinned to CPU(s) %s", cpus);
+
+	return 0;
+}
+
+static int setattr(struct dlattr *attr)
+{
+#ifdef SYS_sched_setattr
+	return syscall(SYS_sched_setattr, 0, attr, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * Period is a tenth of the shortest kick interval, or client timeout,
+ * so we run well ahead of any deadline.  Runtime covers the WDT kicks,
+ * timers, and the expected client kicks per period, at most half the
+ * period.
+ */
+static void derive(unsigned int *rt, unsigned int *per)
+{
+	unsigned int tmo, load, kicks;
+	unsigned int msec = period;
+	struct wdt *dev = NULL;
+
+	while ((dev = wdt_next(dev))) {
+		if (dev->interval > 0 && (unsigned int)dev->interval < msec)
+			msec = dev->interval;
+	}
+
+	load = supervisor_load(&tmo);
+	if (tmo && tmo < msec)
+		msec = tmo;
+
+	*per = dl_period;
+	if (!*per) {
+		*per = msec * 100;	/* msec / 10, in usec */
+		if (*per < DL_PERIOD_MIN)
+			*per = DL_PERIOD_MIN;
+		if (*per > DL_PERIOD_MAX)
+			*per = DL_PERIOD_MAX;
+	}
+
+	*rt = dl_runtime;
+	if (!*rt) {
+		/* Client kicks per second, scaled to our period, rounded up */
+		kicks = ((uint64_t)load * *per + 999999) / 1000000;
+		*rt = DL_RUNTIME_BASE + kicks * DL_RUNTIME_KICK;
+		if (*rt > *per / 2)
+			*rt = *per / 2;
+	}
+}
+
+static int set_deadline(void)
+{
+	struct dlattr attr;
+	unsigned int rt, per;
+
+	derive(&rt, &per);
+	if (dl_active && rt == cur_runtime && per == cur_period)
+		return 0;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size           = sizeof(attr);
+	attr.sched_policy   = SCHED_DEADLINE;
+	attr.sched_flags    = SCHED_FLAG_RESET_ON_FORK; /* Scripts */
+	attr.sched_runtime  = (uint64_t)rt * 1000;
+	attr.sched_deadline = (uint64_t)per * 1000;
+	attr.sched_period   = (uint64_t)per * 1000;
+
+	if (setattr(&attr)) {
+		if (!wdt_testmode())
+			WARN("Failed setting SCHED_DEADLINE runtime %u us period %u us: %s, "
+			     "falling back to %s.", rt, per, strerror(errno),
+			     rtprio > 0 ? "SCHED_RR" : "SCHED_OTHER");
+		dl_active = 0;
+		dl_failed = 1;
+		return -1;
+	}
+
+	if (!dl_active)
+		INFO("Setting SCHED_DEADLINE runtime %u us period %u us", rt, per);
+	else
+		DEBUG("Adjusting SCHED_DEADLINE runtime %u us period %u us", rt, per);
+	cur_runtime = rt;
+	cur_period  = per;
+	dl_active   = 1;
+
+	return 0;
+}
+
+static void set_priority(void)
+{
+	struct sched_param prio;
+	int rc = 0;
+
+	if (rtprio > 0) {
+		DEBUG("Setting SCHED_RR rtprio %d", rtprio);
+		prio.sched_priority = rtprio;
+		rc = sched_setscheduler(getpid(), SCHED_RR, &prio);
+	} else {
+		DEBUG("Setting SCHED_OTHER prio %d", 0);
+		prio.sched_priority = 0;
+		rc = sched_setscheduler(getpid(), SCHED_OTHER, &prio);
+	}
+	dl_active = 0;
+
+	if (rc && !wdt_testmode())
+		PERROR("Failed setting process %spriority", rtprio > 0 ? "realtime " : "");
+}
+
+static void apply(void)
+{
+	if (deadline && !dl_failed && !set_deadline())
+		return;
+
+	set_priority();
+}
+
+/*
+ * Called by the process supervisor with the requested SCHED_RR
+ * priority, or zero for SCHED_OTHER.  With SCHED_DEADLINE in effect
+ * this is the fallback.
+ */
+void realtime_priority(int prio)
+{
+	rtprio = prio;
+	apply();
+}
+
+/* WDT kick interval or supervisor load changed, adjust runtime/period */
+void realtime_update(void)
+{
+	if (!dl_active)
+		return;
+
+	if (set_deadline())
+		set_priority();
+}
+
+/* Format current CPU affinity as a list, e.g. "0-1,3" */
+static void cpulist(char *buf, size_t len)
+{
+	cpu_set_t set;
+	int i, n = 0;
+
+	buf[0] = 0;
+	if (sched_getaffinity(0, sizeof(set), &set))
+		return;
+
+	for (i = 0; i < CPU_SETSIZE; i++) {
+		char tmp[24];
+		int j;
+
+		if (!CPU_ISSET(i, &set))
+			continue;
+
+		for (j = i; j + 1 < CPU_SETSIZE && CPU_ISSET(j + 1, &set); j++)
+			;
+
+		if (j > i)
+			snprintf(tmp, sizeof(tmp), "%s%d-%d", n++ ? "," : "", i, j);
+		else
+			snprintf(tmp, sizeof(tmp), "%s%d", n++ ? "," : "", i);
+		strlcat(buf, tmp, len);
+		i = j;
+	}
+}
+
+int realtime_list(int sd)
+{
+	struct sched_param param;
+	wdog_t resp;
+	long min, maj;
+
+	memset(&resp, 0, sizeof(resp));
+	resp.cmd = WDOG_REALTIME_CMD;
+	cpulist(resp.label, sizeof(resp.label));
+
+	resp.rt.policy = sched_getscheduler(0);
+	if (!sched_getparam(0, &param))
+		resp.rt.priority = param.sched_priority;
+	resp.rt.locked = locked;
+	resp.rt.stack  = stack_kib;
+	resp.rt.heap   = heap_kib;
+	if (dl_active) {
+		resp.rt.runtime  = cur_runtime;
+		resp.rt.deadline = cur_period;
+		resp.rt.period   = cur_period;
+	}
+
+	faults(&min, &maj);
+	resp.rt.minflt_hi = WDOG_HI32(min);
+	resp.rt.minflt_lo = WDOG_LO32(min);
+	resp.rt.majflt_hi = WDOG_HI32(maj);
+	resp.rt.majflt_lo = WDOG_LO32(maj);
+	if (locked) {
+		resp.rt.minflt_locked_hi = WDOG_HI32(min - minflt);
+		resp.rt.minflt_locked_lo = WDOG_LO32(min - minflt);
+		resp.rt.majflt_locked_hi = WDOG_HI32(maj - majflt);
+		resp.rt.majflt_locked_lo = WDOG_LO32(maj - majflt);
+	}
+
+	if (write(sd, &resp, sizeof(resp)) != sizeof(resp)) {
+		PERROR("Failed sending real-time status");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Called on every .conf (re)load, after the WDT devices have been set
+ * up.  Affinity must be set before SCHED_DEADLINE, the kernel refuses
+ * a deadline task affinity to a subset of the CPUs.
+ */
+int realtime_init(int mlock, int stack, int heap, char *cpus, int dl, int rt, int per)
+{
+	int rc = 0;
+
+	if (mlock)
+		rc += lock(stack, heap);
+	else
+		unlock();
+
+	rc += pin(cpus);
+
+	deadline   = dl;
+	dl_runtime = rt;
+	dl_period  = per;
+	dl_failed  = 0;
+	dl_active  = 0;		/* Force update */
+	apply();
+
+	return rc;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ * End:
+ */
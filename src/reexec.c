@@ -0,0 +1,419 @@
+/* Re-exec upgrade, hand over WDT and API descriptors to a new binary
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The upgrade keeps the PID of watchdogd, which is what most init
+ * systems track.  On request the daemon forks a helper which inherits
+ * copies of all WDT descriptors and the API socket.  The daemon itself
+ * then exec's the (new) binary from disk with --takeover=FD, where FD
+ * is one end of a socketpair.  The helper sends all descriptors back
+ * over the socketpair using SCM_RIGHTS, and keeps kicking the WDTs on
+ * its own until the new image has taken over, so there is no gap.
+ *
+ * Subscribed clients are re-adopted by the new image from the
+ * supervisor's memory mapped subscriber table.
+ *
+ * If the new image fails to start, the helper closes its descriptors
+ * without disarming the WDTs, so the system resets, as it should.
+ */
+
+#include <poll.h>
+#include <sys/socket.h>
+#include "wdt.h"
+#include "api.h"
+#include "history.h"
+#include "reexec.h"
+
+#define HANDOFF_MAGIC   0x57444f55	/* "WDOU" */
+#define HANDOFF_VERSION 1
+#define HANDOFF_MAX     8		/* Max number of WDT devices */
+
+struct handoff {
+	uint32_t magic;
+	uint32_t version;
+	int32_t  api;			/* 1: first fd is the API socket */
+	uint32_t ndev;
+	int32_t  interval;		/* Shortest kick interval, msec */
+	char     name[HANDOFF_MAX][64];
+};
+
+static char **args;
+static int    nargs;
+
+static int    chan = -1;		/* Takeover channel to helper */
+static struct handoff ho;
+static int    fds[HANDOFF_MAX + 1];
+static int    nfds;
+
+
+/*
+ * Save a copy of the command line, main() modifies argv[0] and we need
+ * the original arguments when exec'ing the new binary.
+ */
+int reexec_init(int argc, char *argv[])
+{
+	int i;
+
+	args = calloc(argc + 2, sizeof(char *));
+	if (!args)
+		return -1;
+
+	for (i = 0; i < argc; i++) {
+		/* Drop any --takeover from a previous upgrade */
+		if (!strncmp(argv[i], "--takeover", 10))
+			continue;
+
+		args[nargs++] = strdup(argv[i]);
+	}
+
+	return 0;
+}
+
+static void cloexec(int fd, int on)
+{
+	int flags = fcntl(fd, F_GETFD);
+
+	if (flags == -1)
+		return;
+
+	if (on)
+		flags |= FD_CLOEXEC;
+	else
+		flags &= ~FD_CLOEXEC;
+	fcntl(fd, F_SETFD, flags);
+}
+
+/* Kick all WDTs until the new image tells us it's up, or exits */
+static void helper(int sd, int *fd, int num, int interval)
+{
+	struct pollfd pfd = { .fd = sd, .events = POLLIN };
+	int dummy, i;
+
+	if (interval < 1)
+		interval = 1;
+
+	while (1) {
+		int rc;
+
+		rc = poll(&pfd, 1, interval);
+		if (rc == -1 && errno != EINTR)
+			break;
+		if (rc > 0) {
+			char ack;
+
+			if (read(sd, &ack, 1) == 1)
+				DEBUG("Upgrade helper, new image has taken over.");
+			else
+				WARN("Upgrade helper, takeover aborted.");
+			break;
+		}
+
+		for (i = 0; i < num; i++)
+			(void)ioctl(fd[i], WDIOC_KEEPALIVE, &dummy);
+	}
+
+	_exit(0);
+}
+
+static int send_fds(int sd, struct handoff *h, int *fd, int num)
+{
+	char buf[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov = { .iov_base = h, .iov_len = sizeof(*h) };
+	struct msghdr msg = {
+		.msg_iov    = &iov,
+		.msg_iovlen = 1,
+	};
+	struct cmsghdr *cmsg;
+
+	if (num > 0) {
+		memset(buf, 0, sizeof(buf));
+		msg.msg_control    = buf;
+		msg.msg_controllen = CMSG_SPACE(num * sizeof(int));
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type  = SCM_RIGHTS;
+		cmsg->cmsg_len   = CMSG_LEN(num * sizeof(int));
+		memcpy(CMSG_DATA(cmsg), fd, num * sizeof(int));
+	}
+
+	if (sendmsg(sd, &msg, 0) != (ssize_t)sizeof(*h))
+		return -1;
+
+	return 0;
+}
+
+static char *binary(void)
+{
+	static char path[256];
+	ssize_t len;
+	char *ptr;
+
+	/* After a package upgrade the link reads '/path/to/bin (deleted)' */
+	len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if (len <= 0)
+		return args[0];
+
+	path[len] = 0;
+	ptr = strstr(path, " (deleted)");
+	if (ptr)
+		*ptr = 0;
+
+	return path;
+}
+
+/*
+ * Called from API with the reply to the client already sent.  Only
+ * returns on error, in which case we continue running as before.
+ */
+int reexec(void)
+{
+	char opt[32], *path;
+	struct handoff h = { 0 };
+	int fd[HANDOFF_MAX + 1];
+	struct wdt *dev = NULL;
+	int sv[2], num = 0, i, err;
+	sigset_t mask, omask;
+	pid_t pid;
+
+	if (!args) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* The helper kicks the WDTs, must not extend the reset latency */
+	if (!wdt_healthy()) {
+		ERROR("Health lost, refusing to upgrade.");
+		errno = ECANCELED;
+		return -1;
+	}
+
+	h.magic    = HANDOFF_MAGIC;
+	h.version  = HANDOFF_VERSION;
+	h.interval = period;
+
+	fd[num] = api_fd();
+	if (fd[num] != -1) {
+		h.api = 1;
+		num++;
+	}
+
+	while ((dev = wdt_next(dev))) {
+		if (dev->fd == -1)
+			continue;
+
+		if (h.ndev == HANDOFF_MAX) {
+			ERROR("Too many WDT devices for upgrade, max %d.", HANDOFF_MAX);
+			errno = E2BIG;
+			return -1;
+		}
+
+		strlcpy(h.name[h.ndev++], dev->name, sizeof(h.name[0]));
+		if (dev->interval < h.interval)
+			h.interval = dev->interval;
+		fd[num++] = dev->fd;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+		PERROR("Failed creating upgrade channel");
+		return -1;
+	}
+
+	pid = fork();
+	if (pid == -1) {
+		PERROR("Failed forking upgrade helper");
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+
+	if (!pid) {
+		close(sv[0]);
+		if (send_fds(sv[1], &h, fd, num)) {
+			ERROR("Upgrade helper failed sending descriptors.");
+			_exit(1);
+		}
+
+		/* WDT descriptors only, API socket is now with new image */
+		i = h.api ? 1 : 0;
+		helper(sv[1], &fd[i], num - i, h.interval);
+	}
+
+	close(sv[1]);
+
+	/* Only sv[0] is inherited, the rest are sent back by the helper */
+	for (i = 0; i < num; i++)
+		cloexec(fd[i], 1);
+	cloexec(sv[0], 0);
+
+	snprintf(opt, sizeof(opt), "--takeover=%d", sv[0]);
+	memmove(&args[2], &args[1], nargs * sizeof(char *));
+	args[1] = opt;
+
+	/* New image loads statistics from disk */
+	history_flush();
+
+	path = binary();
+	LOG("Upgrading, re-executing %s ...", path);
+	closelog();
+
+	/* libuEv blocks all signals it handles, don't leak that mask */
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, &omask);
+
+	execv(path, args);
+	err = errno;
+
+	/* Failed, restore and carry on */
+	sigprocmask(SIG_SETMASK, &omask, NULL);
+	openlog(prognm, LOG_NDELAY | LOG_NOWAIT | LOG_PID, LOG_DAEMON);
+	ERROR("Failed re-executing %s: %s", path, strerror(err));
+
+	memmove(&args[1], &args[2], nargs * sizeof(char *));
+	for (i = 0; i < num; i++)
+		cloexec(fd[i], 0);
+	close(sv[0]);		/* EOF, helper exits */
+
+	return -1;
+}
+
+/*
+ * Called early in new image, before wdt_init() and api_init(), with
+ * the descriptor given by --takeover=FD.  Receives all descriptors.
+ */
+int reexec_adopt(int sd)
+{
+	char buf[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov = { .iov_base = &ho, .iov_len = sizeof(ho) };
+	struct msghdr msg = {
+		.msg_iov        = &iov,
+		.msg_iovlen     = 1,
+		.msg_control    = buf,
+		.msg_controllen = sizeof(buf),
+	};
+	struct cmsghdr *cmsg;
+	ssize_t len;
+	int i;
+
+	cloexec(sd, 1);
+	chan = sd;
+
+	len = recvmsg(sd, &msg, MSG_CMSG_CLOEXEC);
+	if (len != (ssize_t)sizeof(ho) || ho.magic != HANDOFF_MAGIC ||
+	    ho.version != HANDOFF_VERSION || ho.ndev > HANDOFF_MAX) {
+		ERROR("Invalid upgrade handoff from previous instance.");
+		memset(&ho, 0, sizeof(ho));
+		return -1;
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		if (nfds > (int)NELEMS(fds))
+			nfds = NELEMS(fds);
+		memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+	}
+
+	if (nfds != (int)ho.ndev + ho.api) {
+		ERROR("Upgrade handoff mismatch, got %d descriptors, expected %d.",
+		      nfds, ho.ndev + ho.api);
+		for (i = 0; i < nfds; i++)
+			close(fds[i]);
+		nfds = 0;
+		memset(&ho, 0, sizeof(ho));
+		return -1;
+	}
+
+	LOG("Taking over %d WDT device(s) and API socket from previous instance.", ho.ndev);
+
+	return 0;
+}
+
+/* Adopted API socket, or -1 */
+int reexec_api(void)
+{
+	int fd;
+
+	if (!ho.api)
+		return -1;
+
+	ho.api = 0;
+	fd = fds[0];
+	cloexec(fd, 1);
+
+	return fd;
+}
+
+/* Adopted descriptor for WDT device @name, or -1 */
+int reexec_fd(const char *name)
+{
+	uint32_t i;
+	int base;
+
+	base = nfds - ho.ndev;
+	for (i = 0; i < ho.ndev; i++) {
+		int fd = fds[base + i];
+
+		if (fd == -1 || strcmp(ho.name[i], name))
+			continue;
+
+		fds[base + i] = -1;
+		cloexec(fd, 1);
+
+		return fd;
+	}
+
+	return -1;
+}
+
+/*
+ * New image is up, with kick timers running.  Close any descriptors
+ * not claimed by the new .conf and release the helper.
+ */
+void reexec_done(void)
+{
+	uint32_t i;
+	int base;
+
+	if (chan == -1)
+		return;
+
+	base = nfds - ho.ndev;
+	for (i = 0; i < ho.ndev; i++) {
+		if (fds[base + i] == -1)
+			continue;
+
+		WARN("%s: not in use after upgrade, closing without disarm!", ho.name[i]);
+		close(fds[base + i]);
+	}
+	if (ho.api)
+		close(fds[0]);
+
+	if (write(chan, "", 1) != 1)
+		PERROR("Failed releasing upgrade helper");
+	close(chan);
+	chan = -1;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ * End:
+ */
@@ -22,6 +22,7 @@ extern int reset_reason_init  (int enabled, char *file);
 extern int reset_reason_set   (wdog_reason_t *reason, pid_t  pid);
 extern int reset_reason_get   (wdog_reason_t *reason, pid_t *pid);
 extern int reset_reason_clear (wdog_reason_t *reason);
+extern const char *reset_reason_path (void);
 
 #endif /* RR_H_ */
 
@@ -143,6 +143,18 @@ int reset_reason_clear(wdog_reason_t *r)
 	return reset_reason_set(r, 0);
 }
 
+/* Current backend file, or NULL if disabled */
+const char *reset_reason_path(void)
+{
+	if (!rrenabled || !rrfile)
+		return NULL;
+
+	if (wdt_testmode())
+		return WDOG_STATE_TEST;
+
+	return rrfile;
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
@@ -16,14 +16,22 @@
  */
 
 #include <sched.h>
-#include <sys/timerfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include "wdt.h"
+#include "hist.h"
 #include "private.h"
 #include "rr.h"
 #include "wdog.h"
+#include "forensic.h"
+#include "history.h"
+#include "lagmon.h"
+#include "realtime.h"
 #include "script.h"
 #include "supervisor.h"
 
+#define GROUP_MAX 16
+
 static struct supervisor {
 	int   id;		/* 0-255, -1: Free */
 	pid_t pid;
@@ -31,6 +39,56 @@ static struct supervisor {
 	int   timeout;		/* Period time, in msec. */
 	uev_t watcher;		/* Process timer */
 	int   ack;		/* Next expected ACK from process */
+	int   pidfd;		/* Process exit notification, -1: none */
+	uev_t exitw;		/* Watcher for pidfd */
+	int   schedfd;		/* /proc/PID/schedstat, -1: none */
+
+	int64_t     sampled;	/* Time of schedstat sample, 0: none */
+	uint64_t    run;	/* Run-time at sample, nsec */
+	uint64_t    delay;	/* Run-delay at sample, nsec */
+	int         starved;	/* Deadline extended once due to starvation */
+
+	int64_t     deadline;	/* Absolute deadline, monotonic msec */
+	int64_t     last_kick;	/* Time of last kick (or subscribe) */
+	struct hist interval;	/* Kick-to-kick interval, msec */
+	int64_t     kick[FORENSIC_KICKS]; /* Last kicks, ring buffer */
+	int         margin;	/* Lowest time left at kick, msec */
+	int         period;	/* Current timeout, incl. any extension */
+	int         soft;	/* Timer is armed for the soft deadline */
+	unsigned    near_miss;	/* Number of soft deadlines crossed */
+
+	float       fast;	/* Kick interval EWMA, short term */
+	float       slow;	/* Kick interval EWMA, long term */
+	float       var;	/* Kick interval EWMA variance, long term */
+	int         drifting;	/* Fast mean outside of normal range */
+	unsigned    drifts;	/* Number of detected drifts */
+
+	unsigned    floor;	/* Min. work/sec, 0: disabled */
+	int         window;	/* Throughput window, msec */
+	unsigned    work;	/* Work counter at start of window */
+	int64_t     work_start;	/* Start of window, 0: no work reported */
+	unsigned    rate;	/* Work/sec in last complete window */
+
+	unsigned    budget;	/* Max loop latency p99, usec, 0: disabled */
+	int         slo_window;	/* Latency window, msec */
+	unsigned    slo_periods;/* Windows over budget before action */
+	unsigned    over;	/* Consecutive windows over budget */
+	int64_t     lat_start;	/* Start of window, 0: no samples */
+	struct hist latency;	/* Loop latency in current window, usec */
+	unsigned    lat_p99;	/* p99 of last complete window */
+
+	struct {
+		char     name[WDOG_STAGE_NAMELEN];
+		unsigned budget;	/* msec */
+	} stage[WDOG_STAGE_MAX];	/* Checkpoint stages, in order */
+	int         nstage;
+	int         cur;	/* Stage in progress, nstage: none */
+	int64_t     stage_start;
+
+	struct hrec *rec;	/* Persistent statistics, or NULL */
+
+	struct group *grp;	/* Group member, uses group timer */
+	int         kicked;	/* Kicked since last group deadline */
 	struct {
 		uev_ctx_t *ctx;
 		pid_t      pid;
@@ -39,10 +97,67 @@ static struct supervisor {
 	} ecb;			/* Supervisor script callback data */
 } process[256];                 /* Max ID 0-255 */
 
+/*
+ * Group of subscribers, e.g., a worker pool, with a single deadline
+ * and a quorum.  Members that have kicked since the last deadline are
+ * counted as alive.
+ */
+static struct group {
+	char      name[WDOG_GROUP_NAMELEN]; /* Empty: free */
+	unsigned  quorum;
+	int       timeout;	/* msec */
+	int       members;
+	int64_t   deadline;
+	uev_t     watcher;
+} group[GROUP_MAX];
+
+/*
+ * Subscriber table, mirrored to a file in /run (tmpfs) so that a
+ * restarted daemon can re-adopt its clients.  Bump the version when
+ * changing the layout, a mismatch discards the table.
+ */
+#define TABLE_MAGIC   0x57444f47	/* "WDOG" */
+#define TABLE_VERSION 5
+
+struct record {
+	int32_t  id;
+	int32_t  pid;			/* 0: free */
+	uint64_t start;			/* Process start time, guards against PID reuse */
+	char     label[48];
+	int32_t  timeout;
+	int32_t  ack;
+	int64_t  deadline;		/* Absolute, monotonic msec */
+	uint32_t floor;			/* Throughput floor, work/sec */
+	int32_t  window;		/* Throughput window, msec */
+	uint32_t budget;		/* Latency budget, usec */
+	int32_t  slo_window;		/* Latency window, msec */
+	uint32_t slo_periods;
+	int32_t  nstage;
+	struct {
+		char     name[WDOG_STAGE_NAMELEN];
+		uint32_t budget;
+	} stage[WDOG_STAGE_MAX];
+	char     group[WDOG_GROUP_NAMELEN];
+	uint32_t quorum;
+};
+
+static struct table {
+	uint32_t      magic;
+	uint32_t      version;
+	uint32_t      count;
+	uint32_t      reclen;
+	struct record rec[NELEMS(process)];
+} *table;
+
 static int   supervisor_enabled;
 static int   supervisor_realtime;
 static char *exec;
 
+static float warning;		/* Soft deadline, fraction of timeout */
+static char *warn_exec;
+
+static float drift;		/* Cadence drift threshold, in std. dev. */
+
 
 static struct supervisor *find_supervised(pid_t pid)
 {
@@ -59,11 +174,310 @@ static struct supervisor *find_supervised(pid_t pid)
 	return NULL;
 }
 
+/*
+ * (Re)arm process timer and record its absolute deadline.  With a soft
+ * deadline the timer first fires at the warning level, see soft_cb(),
+ * and is then re-armed for the remaining time to the hard deadline.
+ */
+static int arm(struct supervisor *p, int msec)
+{
+	int first = msec;
+
+	p->deadline = wdt_msec() + msec;
+	p->period   = msec;
+	p->soft     = 0;
+
+	if (warning > 0.0) {
+		first = (int)(msec * warning);
+		if (first > 0 && first < msec)
+			p->soft = 1;
+		else
+			first = msec;
+	}
+
+	return uev_timer_set(&p->watcher, first, p->soft ? 0 : msec);
+}
+
+/* Read run-time and run-delay, in nsec, of the process' main thread */
+static int schedstat(struct supervisor *p, uint64_t *run, uint64_t *delay)
+{
+	unsigned long long r, d;
+	char buf[80];
+	ssize_t len;
+
+	if (p->schedfd < 0)
+		return -1;
+
+	len = pread(p->schedfd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return -1;
+	buf[len] = 0;
+
+	if (sscanf(buf, "%llu %llu", &r, &d) != 2)
+		return -1;
+
+	*run   = r;
+	*delay = d;
+
+	return 0;
+}
+
+/* Baseline for classify(), taken at every kick */
+static void sample(struct supervisor *p)
+{
+	if (schedstat(p, &p->run, &p->delay))
+		p->sampled = 0;
+	else
+		p->sampled = wdt_msec();
+}
+
+/*
+ * Learn the normal kick cadence of a process using a slow EWMA of the
+ * kick interval, and its variance, and compare with a fast EWMA.  When
+ * the fast mean drifts more than @drift standard deviations above the
+ * normal, the process is slipping.  Very regular processes have close
+ * to zero variance, so the deviation is floored at 1% of the mean.
+ */
+static void cadence(struct supervisor *p, float x)
+{
+	float d, dev, thr;
+
+	if (p->interval.count == 1) {
+		p->fast = p->slow = x;
+		p->var  = 0.0;
+		return;
+	}
+
+	p->fast += (x - p->fast) / 8;
+
+	d = x - p->slow;
+	p->slow += d / 64;
+	p->var   = (p->var + d * d / 64) * 63 / 64;
+
+	if (drift <= 0.0 || p->interval.count < 32)
+		return;
+
+	dev = p->fast - p->slow;
+	thr = drift * drift * (p->var + p->slow * p->slow / 10000 + 1);
+
+	if (!p->drifting) {
+		if (dev <= 0 || dev * dev <= thr)
+			return;
+
+		p->drifting = 1;
+		p->drifts++;
+		WARN("Process %s[%d] kick interval drifting, %.0f msec vs normal %.0f msec.",
+		     p->label, p->pid, p->fast, p->slow);
+	} else if (dev <= 0 || dev * dev < thr / 4) {
+		p->drifting = 0;
+		INFO("Process %s[%d] kick interval back to normal, %.0f msec.",
+		     p->label, p->pid, p->fast);
+	}
+}
+
+/*
+ * Called on every valid kick, must be cheap.  Records kick-to-kick
+ * interval and the margin, i.e., how much time the process had left
+ * before its deadline.
+ */
+static void account(struct supervisor *p)
+{
+	int64_t now, margin;
+	uint32_t interval;
+
+	now = wdt_msec();
+	interval = (uint32_t)(now - p->last_kick);
+	hist_add(&p->interval, interval);
+	p->kick[(p->interval.count - 1) % FORENSIC_KICKS] = now;
+	p->last_kick = now;
+	p->starved = 0;
+	sample(p);
+	cadence(p, (float)interval);
+
+	/* Group members are covered by the group's deadline */
+	margin = (p->grp ? p->grp->deadline : p->deadline) - now;
+	if (p->interval.count == 1 || margin < p->margin)
+		p->margin = (int)margin;
+	history_kick(p->rec, (int)margin);
+}
+
+/* Start time of process, in clock ticks since boot, or 0 on error */
+static uint64_t starttime(pid_t pid)
+{
+	unsigned long long start = 0;
+	char fn[32], buf[512], *ptr;
+	FILE *fp;
+
+	snprintf(fn, sizeof(fn), "/proc/%d/stat", pid);
+	fp = fopen(fn, "r");
+	if (!fp)
+		return 0;
+
+	if (fgets(buf, sizeof(buf), fp)) {
+		/* comm may contain spaces and parenthesis, skip past it */
+		ptr = strrchr(buf, ')');
+		if (!ptr || sscanf(ptr + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u "
+				   "%*d %*d %*d %*d %*d %*d %llu", &start) != 1)
+			start = 0;
+	}
+	fclose(fp);
+
+	return start;
+}
+
+/* Sync supervisor object to subscriber table, cheap enough for kicks */
+static void save(struct supervisor *p)
+{
+	struct record *r;
+
+	if (!table)
+		return;
+
+	r = &table->rec[p->id];
+	if (r->pid != p->pid) {
+		memset(r, 0, sizeof(*r));
+		r->id    = p->id;
+		r->pid   = p->pid;
+		r->start = starttime(p->pid);
+		strlcpy(r->label, p->label, sizeof(r->label));
+	}
+	r->timeout  = p->timeout;
+	r->ack      = p->ack;
+	r->deadline = p->deadline;
+	r->floor    = p->floor;
+	r->window   = p->window;
+	r->budget   = p->budget;
+	r->slo_window  = p->slo_window;
+	r->slo_periods = p->slo_periods;
+	r->nstage      = p->nstage;
+	memcpy(r->stage, p->stage, sizeof(r->stage));
+	if (p->grp) {
+		strlcpy(r->group, p->grp->name, sizeof(r->group));
+		r->quorum = p->grp->quorum;
+	} else {
+		r->group[0] = 0;
+		r->quorum = 0;
+	}
+}
+
+static void erase(int id)
+{
+	if (!table || id < 0 || id >= (int)NELEMS(process))
+		return;
+
+	memset(&table->rec[id], 0, sizeof(table->rec[id]));
+}
+
+/*
+ * Map subscriber table, creating it if missing.  A table with another
+ * layout, e.g. from an older watchdogd, is cleared.
+ */
+static int table_open(void)
+{
+	const char *fn = wdt_testmode() ? WDOG_CLIENTS_TEST : WDOG_CLIENTS;
+	void *ptr;
+	int fd;
+
+	fd = open(fn, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd == -1) {
+		PERROR("Failed opening subscriber table %s", fn);
+		return -1;
+	}
+
+	if (ftruncate(fd, sizeof(struct table))) {
+		PERROR("Failed sizing subscriber table %s", fn);
+		close(fd);
+		return -1;
+	}
+
+	ptr = mmap(NULL, sizeof(struct table), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		PERROR("Failed mapping subscriber table %s", fn);
+		return -1;
+	}
+
+	table = ptr;
+	if (table->magic != TABLE_MAGIC || table->version != TABLE_VERSION ||
+	    table->count != NELEMS(process) || table->reclen != sizeof(struct record)) {
+		DEBUG("Initializing subscriber table %s", fn);
+		memset(table, 0, sizeof(*table));
+		table->magic   = TABLE_MAGIC;
+		table->version = TABLE_VERSION;
+		table->count   = NELEMS(process);
+		table->reclen  = sizeof(struct record);
+	}
+
+	return 0;
+}
+
+/* Not all C libraries have a wrapper, and not all kernels support it */
+static int pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	(void)pid;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static void unwatch(struct supervisor *p)
+{
+	if (p->schedfd >= 0) {
+		close(p->schedfd);
+		p->schedfd = -1;
+	}
+
+	if (p->pidfd < 0)
+		return;
+
+	uev_io_stop(&p->exitw);
+	close(p->pidfd);
+	p->pidfd = -1;
+}
+
+static void leave(struct supervisor *p)
+{
+	struct group *g = p->grp;
+
+	if (!g)
+		return;
+
+	p->grp = NULL;
+	if (--g->members > 0)
+		return;
+
+	DEBUG("Group %s has no members left, removing.", g->name);
+	uev_timer_stop(&g->watcher);
+	memset(g, 0, sizeof(*g));
+}
+
 static void release(struct supervisor *p)
 {
 	uev_timer_stop(&p->watcher);
+	unwatch(p);
+	leave(p);
+	erase(p->id);
+	history_put(p->rec);
 	memset(p, 0, sizeof(*p));
 	p->id = -1;
+	p->pidfd = p->schedfd = -1;
+	realtime_update();
+}
+
+/* Label of process, with the stage in progress appended, if any */
+static const char *what(struct supervisor *p)
+{
+	static char buf[sizeof(p->label) + WDOG_STAGE_NAMELEN + 1];
+
+	if (p->cur >= p->nstage)
+		return p->label;
+
+	snprintf(buf, sizeof(buf), "%s/%s", p->label, p->stage[p->cur].name);
+
+	return buf;
 }
 
 static int reset(uev_ctx_t *ctx, struct supervisor *p, wdog_code_t c, int timeout)
@@ -71,10 +485,11 @@ static int reset(uev_ctx_t *ctx, struct supervisor *p, wdog_code_t c, int timeou
 	wdog_reason_t reason = { 0 };
 
 	uev_timer_stop(&p->watcher);
+	unwatch(p);
 
 	reason.wid  = p->id;
 	reason.code = c;
-	strlcpy(reason.label, p->label, sizeof(reason.label));
+	strlcpy(reason.label, what(p), sizeof(reason.label));
 
 	return wdt_reset(ctx, p->pid, &reason, timeout);
 }
@@ -99,6 +514,7 @@ static void exec_cb(void *arg)
 
 static int action(uev_ctx_t *ctx, struct supervisor *p, wdog_code_t c, int timeout)
 {
+	history_miss(p->rec);
 	if (exec && !access(exec, X_OK)) {
 		if (p->ecb.pid > 0) {
 			INFO("Busy, previous supervisor script for %s has not exited yet.", p->label);
@@ -108,7 +524,7 @@ static int action(uev_ctx_t *ctx, struct supervisor *p, wdog_code_t c, int timeo
 		p->ecb.ctx = ctx;
 		p->ecb.timeout = timeout;
 		p->ecb.code = c;
-		p->ecb.pid = supervisor_exec(exec, c, p->pid, p->label, exec_cb, p);
+		p->ecb.pid = supervisor_exec(exec, c, p->pid, (char *)what(p), exec_cb, p);
 		if (p->ecb.pid > 0) {
 			INFO("Started supervisor script %s, PID %d", exec, p->ecb.pid);
 			return 0;
@@ -117,7 +533,7 @@ static int action(uev_ctx_t *ctx, struct supervisor *p, wdog_code_t c, int timeo
 		PERROR("Failed starting supervisor script %s, calling wdt_reset() for %s", exec, p->label);
 	}
 
-	EMERG("Process %s[%d] failed to meet its deadline, rebooting ...", p->label, p->pid);
+	EMERG("Process %s[%d] failed to meet its deadline, rebooting ...", what(p), p->pid);
 	return reset(ctx, p, c, timeout);
 }
 
@@ -141,6 +557,13 @@ static int supervisor_action(uev_ctx_t *ctx, wdog_t *req, int is_reset)
 	if (is_reset) {
 		cause = WDOG_FAILED_TO_MEET_DEADLINE;
 		timeout = (int)req->timeout;
+	} else if (req->cmd == WDOG_FAILED_CODE_CMD) {
+		if (req->error <= WDOG_CPU_OVERLOAD || req->error > WDOG_WDT_KICK_FAILED) {
+			errno = EINVAL;
+			return 1;
+		}
+		cause = req->error;
+		timeout = req->timeout > 0 ? (int)req->timeout : -1;
 	} else {
 		cause = req->cmd - WDOG_FAILED_BASE_CMD;
 		timeout = req->timeout > 0 ? (int)req->timeout : -1;
@@ -174,27 +597,12 @@ static int supervisor_reset(uev_ctx_t *ctx, wdog_t *req)
  * If any process is being supervised/subscribed, and watchdogd is
  * enabled, we raise the RT priority to 98 (just below the kernel WDT in
  * prio).  This to ensure that system monitoring goes before anything
- * else in the system.
+ * else in the system.  Unless SCHED_DEADLINE is in effect, see the
+ * realtime section in the .conf file.
  */
 static void set_priority(int enabled, int rtprio)
 {
-	struct sched_param prio;
-	int ena;
-	int rc = 0;
-
-	ena = enabled && rtprio > 0;
-	if (ena) {
-		DEBUG("Setting SCHED_RR rtprio %d", rtprio);
-		prio.sched_priority = rtprio;
-		rc = sched_setscheduler(getpid(), SCHED_RR, &prio);
-	} else {
-		DEBUG("Setting SCHED_OTHER prio %d", 0);
-		prio.sched_priority = 0;
-		rc = sched_setscheduler(getpid(), SCHED_OTHER, &prio);
-	}
-
-	if (rc && !wdt_testmode())
-		PERROR("Failed setting process %spriority", ena ? "realtime " : "");
+	realtime_priority(enabled && rtprio > 0 ? rtprio : 0);
 }
 
 /*
@@ -283,24 +691,406 @@ static void next_ack(struct supervisor *p, wdog_t *req)
 	req->next_ack  = p->ack;
 }
 
-/* Client timed out.  Save pid & label in reset reason, sync and reboot */
+/*
+ * Client crossed its soft deadline.  Log a warning, record the near
+ * miss and notify the optional warning-script, then re-arm the timer
+ * for the remaining time to the hard deadline.
+ */
+static void soft_cb(uev_t *w, struct supervisor *p)
+{
+	int64_t left;
+	char val[12];
+
+	p->soft = 0;
+	p->near_miss++;
+	history_near(p->rec);
+
+	left = p->deadline - wdt_msec();
+	if (left < 1)
+		left = 1;
+
+	WARN("Process %s[%d] has not kicked in %d msec, %d msec left to deadline!",
+	     p->label, p->pid, (int)(p->period - left), (int)left);
+
+	if (warn_exec) {
+		snprintf(val, sizeof(val), "%d", p->pid);
+		setenv("SUPERVISOR_PID", val, 1);
+		setenv("SUPERVISOR_LABEL", p->label, 1);
+		checker_exec(warn_exec, "supervisor", 0,
+			     (double)(p->period - left) / p->period, warning, 1.0);
+		unsetenv("SUPERVISOR_PID");
+		unsetenv("SUPERVISOR_LABEL");
+	}
+
+	uev_timer_set(w, (int)left, p->period);
+}
+
+/* Save forensics of a stuck process, with the last kicks oldest first */
+static void snapshot(struct supervisor *p)
+{
+	int64_t kick[FORENSIC_KICKS];
+	unsigned i, num, first;
+
+	num = p->interval.count;
+	if (num > FORENSIC_KICKS)
+		num = FORENSIC_KICKS;
+
+	first = p->interval.count - num;
+	for (i = 0; i < num; i++)
+		kick[i] = p->kick[(first + i) % FORENSIC_KICKS];
+
+	forensic_save(p->pid, what(p), kick, (int)num);
+}
+
+/*
+ * Classify a missed deadline from the schedstat deltas since the last
+ * kick.  A process that has been on the CPU for more than half of the
+ * time is spinning, one that has been waiting for a CPU more than a
+ * quarter of the time is starved, otherwise it is blocked, sleeping
+ * on something that never happened.
+ */
+static wdog_code_t classify(struct supervisor *p)
+{
+	uint64_t run, delay, elapsed;
+
+	if (!p->sampled || schedstat(p, &run, &delay))
+		return WDOG_FAILED_TO_MEET_DEADLINE;
+
+	elapsed = (uint64_t)(wdt_msec() - p->sampled) * 1000000;
+	if (!elapsed)
+		return WDOG_FAILED_TO_MEET_DEADLINE;
+
+	run   -= p->run;
+	delay -= p->delay;
+	INFO("Process %s[%d] ran %llu msec, waited %llu msec for CPU, in %llu msec.",
+	     p->label, p->pid, (unsigned long long)run / 1000000,
+	     (unsigned long long)delay / 1000000, (unsigned long long)elapsed / 1000000);
+
+	if (run * 2 >= elapsed)
+		return WDOG_PROCESS_SPINNING;
+	if (delay * 4 >= elapsed)
+		return WDOG_PROCESS_STARVED;
+
+	return WDOG_PROCESS_BLOCKED;
+}
+
+/*
+ * Client timed out.  Save pid & label in reset reason, sync and reboot.
+ * A process starved of CPU is given one more period, restarting it is
+ * unlikely to help, if it is still starved after that we act.
+ */
 static void timeout_cb(uev_t *w, void *arg, int events)
 {
 	struct supervisor *p = (struct supervisor *)arg;
+	wdog_code_t code;
 
+	if (p->soft) {
+		soft_cb(w, p);
+		return;
+	}
+
+	code = classify(p);
+	if (code == WDOG_PROCESS_STARVED && !p->starved) {
+		WARN("Process %s[%d] starved of CPU, extending deadline %d msec.",
+		     p->label, p->pid, p->period);
+		p->starved = 1;
+		arm(p, p->period);
+		save(p);
+		return;
+	}
+
+	if (p->cur < p->nstage)
+		EMERG("Process %s[%d] stuck in stage %s for %d msec, budget %u msec.",
+		      p->label, p->pid, p->stage[p->cur].name,
+		      (int)(wdt_msec() - p->stage_start), p->stage[p->cur].budget);
+
+	lagmon_enter("forensics", p->label);
+	snapshot(p);
+	lagmon_leave();
+	action(w->ctx, p, code, 0);
+}
+
+/*
+ * Checkpoint reached, i.e., end of stage @idx.  Stage time is checked
+ * against its budget and the next stage, if any, is started.
+ */
+static void checkpoint(struct supervisor *p, int idx)
+{
+	int64_t now = wdt_msec();
+	int64_t elapsed;
+
+	elapsed = now - p->stage_start;
+	if (elapsed > p->stage[idx].budget)
+		WARN("Process %s[%d] stage %s overran its budget, %d > %u msec.",
+		     p->label, p->pid, p->stage[idx].name, (int)elapsed, p->stage[idx].budget);
+
+	p->cur = idx + 1;
+	p->stage_start = now;
+}
+
+/*
+ * Called on kicks with a work counter.  The rate of work is calculated
+ * over consecutive windows, if a throughput floor is set and the rate
+ * is below it the process is considered failed, even though it kicks.
+ * Without a floor the window defaults to the timeout, for statistics.
+ *
+ * Returns non-zero if action was taken.
+ */
+static int progress(uev_ctx_t *ctx, struct supervisor *p, unsigned int work)
+{
+	int64_t now = wdt_msec();
+	int64_t elapsed;
+	int window;
+
+	if (!p->work_start) {
+		p->work       = work;
+		p->work_start = now;
+		return 0;
+	}
+
+	window = p->window ?: p->timeout;
+	elapsed = now - p->work_start;
+	if (elapsed < window || elapsed <= 0)
+		return 0;
+
+	/* Unsigned arithmetic handles counter wrap-around */
+	p->rate = (unsigned)((uint64_t)(work - p->work) * 1000 / elapsed);
+	p->work       = work;
+	p->work_start = now;
+
+	if (!p->floor || p->rate >= p->floor || !enabled)
+		return 0;
+
+	EMERG("Process %s[%d] throughput %u/sec below floor %u/sec!",
+	      p->label, p->pid, p->rate, p->floor);
+	action(ctx, p, WDOG_FAILED_TO_MEET_DEADLINE, 0);
+
+	return 1;
+}
+
+/*
+ * Called on kicks with latency samples.  The p99 is calculated over
+ * consecutive windows, each window over budget is logged and after
+ * slo_periods consecutive windows over budget the process is
+ * considered failed.  Without a budget the window defaults to the
+ * timeout, for statistics.
+ *
+ * Returns non-zero if action was taken.
+ */
+static int latency(uev_ctx_t *ctx, struct supervisor *p, unsigned int *sample, unsigned int num)
+{
+	int64_t now = wdt_msec();
+	unsigned int i;
+	int window;
+
+	if (num > WDOG_LATENCY_SAMPLES)
+		num = WDOG_LATENCY_SAMPLES;
+	for (i = 0; i < num; i++)
+		hist_add(&p->latency, sample[i]);
+
+	if (!p->lat_start) {
+		p->lat_start = now;
+		return 0;
+	}
+
+	window = p->slo_window ?: p->timeout;
+	if (now - p->lat_start < window)
+		return 0;
+
+	p->lat_p99   = hist_percentile(&p->latency, 99);
+	p->lat_start = now;
+	hist_clear(&p->latency);
+
+	if (!p->budget || p->lat_p99 <= p->budget) {
+		p->over = 0;
+		return 0;
+	}
+
+	p->over++;
+	WARN("Process %s[%d] loop latency p99 %u usec over budget %u usec, %u time(s) in a row.",
+	     p->label, p->pid, p->lat_p99, p->budget, p->over);
+	if (!p->slo_periods || p->over < p->slo_periods || !enabled)
+		return 0;
+
+	EMERG("Process %s[%d] loop latency over budget for %u periods!", p->label, p->pid, p->over);
+	p->over = 0;
+	action(ctx, p, WDOG_FAILED_TO_MEET_DEADLINE, 0);
+
+	return 1;
+}
+
+/*
+ * Group deadline, count members that have kicked since last time.  If
+ * too few are alive, act on behalf of the first stale member.
+ */
+static void group_cb(uev_t *w, void *arg, int events)
+{
+	struct group *g = (struct group *)arg;
+	struct supervisor *stale = NULL;
+	unsigned alive = 0;
+	size_t i;
+
+	g->deadline = wdt_msec() + g->timeout;
+
+	for (i = 0; i < NELEMS(process); i++) {
+		struct supervisor *p = &process[i];
+
+		if (p->id == -1 || p->grp != g)
+			continue;
+
+		if (p->kicked)
+			alive++;
+		else if (!stale)
+			stale = p;
+		p->kicked = 0;
+	}
+
+	if (alive >= g->quorum || !stale)
+		return;
+
+	EMERG("Group %s has %u of %d members alive, below quorum %u!",
+	      g->name, alive, g->members, g->quorum);
+	action(w->ctx, stale, WDOG_FAILED_TO_MEET_DEADLINE, 0);
+}
+
+/*
+ * Add process to group @name, creating the group if needed.  Members
+ * do not have their own deadline, they are covered by the group's.
+ */
+static int join(uev_ctx_t *ctx, struct supervisor *p, const char *name, unsigned quorum)
+{
+	struct group *g = NULL, *avail = NULL;
+	size_t i;
+
+	for (i = 0; i < NELEMS(group); i++) {
+		if (!group[i].name[0]) {
+			if (!avail)
+				avail = &group[i];
+			continue;
+		}
+
+		if (!strcmp(group[i].name, name)) {
+			g = &group[i];
+			break;
+		}
+	}
+
+	if (!g) {
+		if (!avail) {
+			errno = ENOSPC;
+			return -1;
+		}
+
+		g = avail;
+		strlcpy(g->name, name, sizeof(g->name));
+		g->quorum   = quorum;
+		g->timeout  = p->timeout + 500;
+		g->deadline = wdt_msec() + g->timeout;
+		uev_timer_init(ctx, &g->watcher, group_cb, g, g->timeout, g->timeout);
+		if (!enabled)
+			uev_timer_stop(&g->watcher);
+		INFO("Created group %s, quorum %u, timeout %d msec", g->name, g->quorum, g->timeout);
+	}
+
+	leave(p);
+	uev_timer_stop(&p->watcher);
+	p->grp    = g;
+	p->kicked = 1;
+	g->members++;
+	DEBUG("%s[%d] joined group %s, now %d members", p->label, p->pid, g->name, g->members);
+
+	return 0;
+}
+
+/*
+ * Client process exited, or crashed, without unsubscribing first.  No
+ * need to wait for the deadline, it will never kick again.  When the
+ * supervisor is disabled we just free the slot.
+ */
+static void exit_cb(uev_t *w, void *arg, int events)
+{
+	struct supervisor *p = (struct supervisor *)arg;
+
+	unwatch(p);
+
+	if (!enabled || p->grp) {
+		INFO("Process %s[%d] exited, releasing id:%d.", p->label, p->pid, p->id);
+		release(p);
+		return;
+	}
+
+	EMERG("Process %s[%d] exited without unsubscribing!", p->label, p->pid);
 	action(w->ctx, p, WDOG_FAILED_TO_MEET_DEADLINE, 0);
 }
 
+/*
+ * Set up exit notification for client process.  Falls back to only
+ * the process timer on systems without pidfd support (Linux < 5.3)
+ */
+static void watch(uev_ctx_t *ctx, struct supervisor *p)
+{
+	char path[32];
+	int fd;
+
+	/* Kept open, sampled with pread() on every kick */
+	snprintf(path, sizeof(path), "/proc/%d/schedstat", p->pid);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		p->schedfd = fd;
+		sample(p);
+	}
+
+	fd = pidfd_open(p->pid);
+	if (fd < 0) {
+		if (errno != ENOSYS)
+			PERROR("Failed opening pidfd for %s[%d]", p->label, p->pid);
+		return;
+	}
+
+	if (uev_io_init(ctx, &p->exitw, exit_cb, p, fd, UEV_READ)) {
+		PERROR("Failed watching %s[%d] for exit", p->label, p->pid);
+		close(fd);
+		return;
+	}
+	p->pidfd = fd;
+}
+
+/*
+ * Estimated client kicks per second, assuming clients kick at half
+ * their timeout, and the shortest client timeout (msec), or zero.
+ */
+unsigned int supervisor_load(unsigned int *tmo)
+{
+	unsigned int load = 0;
+	size_t i;
+
+	*tmo = 0;
+	for (i = 0; i < NELEMS(process); i++) {
+		struct supervisor *p = &process[i];
+
+		if (p->id == -1 || p->timeout <= 0)
+			continue;
+
+		load += (2000 + p->timeout - 1) / p->timeout;
+		if (!*tmo || (unsigned int)p->timeout < *tmo)
+			*tmo = p->timeout;
+	}
+
+	return load;
+}
+
 /*
  * Send list of subscribed clients via socket
  *
  * Sends one wdog_t struct per subscribed client. The client reads
- * multiple responses until the connection closes.
+ * multiple responses until the connection closes.  The same reply is
+ * used for %WDOG_LIST_SUPV_CLIENTS_CMD and %WDOG_CLIENT_STATS_CMD.
  *
- * Returns: 0 on success, -1 on error
+ * Returns: number of clients sent, or -1 on error
  */
-int supervisor_list_clients(int sd)
+int supervisor_list_clients(int sd, int cmd)
 {
+	int64_t now = wdt_msec(), deadline;
 	wdog_t resp;
 	size_t i;
 	int count = 0;
@@ -313,21 +1103,28 @@ int supervisor_list_clients(int sd)
 			continue;
 
 		memset(&resp, 0, sizeof(resp));
-		resp.cmd = WDOG_LIST_SUPV_CLIENTS_CMD;
+		resp.cmd = cmd;
 		resp.id = process[i].id;
 		resp.pid = process[i].pid;
 		resp.timeout = process[i].timeout;
 		strlcpy(resp.label, process[i].label, sizeof(resp.label));
 
-		/* Get time left from timerfd */
-		struct itimerspec time_left;
-		if (timerfd_gettime(process[i].watcher.fd, &time_left) == 0) {
-			long long ms = time_left.it_value.tv_sec * 1000 +
-				       time_left.it_value.tv_nsec / 1000000;
-			resp.next_ack = (unsigned int)ms;
-		} else {
+		/* Time left to deadline, timer is stopped when disabled */
+		deadline = process[i].grp ? process[i].grp->deadline : process[i].deadline;
+		if (enabled && deadline > now)
+			resp.next_ack = (unsigned int)(deadline - now);
+		else
 			resp.next_ack = 0;
-		}
+
+		resp.stats.kicks  = process[i].interval.count;
+		resp.stats.p50    = hist_percentile(&process[i].interval, 50);
+		resp.stats.p99    = hist_percentile(&process[i].interval, 99);
+		resp.stats.max    = process[i].interval.max;
+		resp.stats.margin = process[i].margin;
+		resp.stats.near_miss = process[i].near_miss;
+		resp.stats.rate   = process[i].rate;
+		resp.stats.latency = process[i].lat_p99;
+		resp.stats.drifts = process[i].drifts;
 
 		if (write(sd, &resp, sizeof(resp)) != sizeof(resp))
 			return -1;
@@ -361,9 +1158,17 @@ int supervisor_cmd(uev_ctx_t *ctx, wdog_t *req)
 			DEBUG("%s[%d] next ack: %d", req->label, req->pid,
 			      req->next_ack);
 
+			p->rec = history_get(p->label);
+			history_start(p->rec);
+
 			/* Allow for some scheduling slack */
+			p->last_kick = wdt_msec();
 			uev_timer_init(ctx, &p->watcher, timeout_cb, p,
 				       p->timeout + 500, p->timeout + 500);
+			arm(p, p->timeout + 500);
+			watch(ctx, p);
+			save(p);
+			realtime_update();
 		}
 		break;
 
@@ -404,11 +1209,149 @@ int supervisor_cmd(uev_ctx_t *ctx, wdog_t *req)
 			DEBUG("How do you do %s[%d], id:%d?  ACK should be %d, is %d",
 			      req->label, req->pid, req->id, p->ack, req->ack);
 			next_ack(p, req);
-			if (enabled)
-				uev_timer_set(&p->watcher, msec, msec);
+			account(p);
+			if (p->grp)
+				p->kicked = 1;
+			else if (enabled)
+				arm(p, msec);
+			save(p);
+
+			/* A kick starts a new round of stages */
+			p->cur = 0;
+			p->stage_start = wdt_msec();
+
+			if ((req->kick.flags & WDOG_KICK_WORK) &&
+			    progress(ctx, p, req->kick.work))
+				break;
+			if (req->kick.flags & WDOG_KICK_LATENCY)
+				latency(ctx, p, req->kick.sample, req->kick.count);
 		}
 		break;
 
+	case WDOG_THROUGHPUT_CMD:
+		p = get(req->id, req->pid, req->ack);
+		if (!p) {
+			fail(ctx, req, WDOG_FAILED_KICK, "tried to set throughput floor with invalid credentials");
+			req->cmd   = WDOG_CMD_ERROR;
+			req->error = errno;
+			break;
+		}
+
+		if (req->floor.rate && req->floor.window < WDOG_SUPERVISOR_MIN_TIMEOUT) {
+			req->cmd   = WDOG_CMD_ERROR;
+			req->error = EINVAL;
+			break;
+		}
+
+		DEBUG("%s[%d] throughput floor %u/sec, window %u msec", p->label, p->pid,
+		      req->floor.rate, req->floor.window);
+		p->floor      = req->floor.rate;
+		p->window     = req->floor.rate ? (int)req->floor.window : 0;
+		p->work_start = 0;
+		next_ack(p, req);
+		save(p);
+		break;
+
+	case WDOG_STAGE_CMD:
+		p = get(req->id, req->pid, req->ack);
+		if (!p) {
+			fail(ctx, req, WDOG_FAILED_KICK, "tried to declare stage with invalid credentials");
+			req->cmd   = WDOG_CMD_ERROR;
+			req->error = errno;
+			break;
+		}
+
+		if (p->nstage >= WDOG_STAGE_MAX) {
+			req->cmd   = WDOG_CMD_ERROR;
+			req->error = ENOSPC;
+			break;
+		}
+
+		req->stage.name[sizeof(req->stage.name) - 1] = 0;
+		strlcpy(p->stage[p->nstage].name, req->stage.name, sizeof(p->stage[0].name));
+		p->stage[p->nstage].budget = req->stage.budget;
+		DEBUG("%s[%d] stage %d %s, budget %u msec", p->label, p->pid, p->nstage,
+		      req->stage.name, req->stage.budget);
+
+		req->stage.index = p->nstage++;
+		p->cur = p->nstage;	/* Not started until next kick */
+		next_ack(p, req);
+		save(p);
+		break;
+
+	case WDOG_CHECKPOINT_CMD:
+		p = get(req->id, req->pid, req->ack);
+		if (!p) {
+			fail(ctx, req, WDOG_FAILED_KICK, "tried to report checkpoint with invalid credentials");
+			req->cmd   = WDOG_CMD_ERROR;
+			req->error = errno;
+			break;
+		}
+
+		if (req->stage.index < 0 || req->stage.index >= p->nstage) {
+			req->cmd   = WDOG_CMD_ERROR;
+			req->error = EINVAL;
+			break;
+		}
+
+		checkpoint(p, req->stage.index);
+		next_ack(p, req);
+		save(p);
+		break;
+
+	case WDOG_JOIN_CMD:
+		p = get(req->id, req->pid, req->ack);
+		if (!p) {
+			fail(ctx, req, WDOG_FAILED_KICK, "tried to join group with invalid credentials");
+			req->cmd   = WDOG_CMD_ERROR;
+			req->error = errno;
+			break;
+		}
+
+		req->group.name[sizeof(req->group.name) - 1] = 0;
+		if (!req->group.name[0] || !req->group.quorum ||
+		    req->group.quorum > NELEMS(process)) {
+			req->cmd   = WDOG_CMD_ERROR;
+			req->error = EINVAL;
+			break;
+		}
+		if (join(ctx, p, req->group.name, req->group.quorum)) {
+			req->cmd   = WDOG_CMD_ERROR;
+			req->error = errno;
+			break;
+		}
+
+		next_ack(p, req);
+		save(p);
+		break;
+
+	case WDOG_LATENCY_CMD:
+		p = get(req->id, req->pid, req->ack);
+		if (!p) {
+			fail(ctx, req, WDOG_FAILED_KICK, "tried to set latency budget with invalid credentials");
+			req->cmd   = WDOG_CMD_ERROR;
+			req->error = errno;
+			break;
+		}
+
+		if (req->slo.budget && req->slo.window < WDOG_SUPERVISOR_MIN_TIMEOUT) {
+			req->cmd   = WDOG_CMD_ERROR;
+			req->error = EINVAL;
+			break;
+		}
+
+		DEBUG("%s[%d] latency budget %u usec, window %u msec, periods %u", p->label, p->pid,
+		      req->slo.budget, req->slo.window, req->slo.periods);
+		p->budget      = req->slo.budget;
+		p->slo_window  = req->slo.budget ? (int)req->slo.window : 0;
+		p->slo_periods = req->slo.periods;
+		p->over        = 0;
+		p->lat_start   = 0;
+		hist_clear(&p->latency);
+		next_ack(p, req);
+		save(p);
+		break;
+
 	case WDOG_RESET_COUNTER_CMD:
 		req->next_ack = wdt_reset_counter();
 		break;
@@ -421,6 +1364,7 @@ int supervisor_cmd(uev_ctx_t *ctx, wdog_t *req)
 		break;
 
 	case WDOG_FAILED_SYSTEMOK_CMD...WDOG_FAILED_OVERLOAD_CMD:
+	case WDOG_FAILED_CODE_CMD:
 		if (supervisor_failed(ctx, req)) {
 			req->cmd   = WDOG_CMD_ERROR;
 			req->error = errno;
@@ -456,15 +1400,77 @@ int supervisor_cmd(uev_ctx_t *ctx, wdog_t *req)
 	return 0;
 }
 
+/*
+ * Re-adopt clients from a previous instance of watchdogd, skipping any
+ * that have exited, or whose PID has been reused.  The clients could
+ * not kick while we were away, so they get at least one full period.
+ */
+static void adopt(uev_ctx_t *ctx)
+{
+	int64_t now = wdt_msec();
+	size_t i;
+
+	if (table_open())
+		return;
+
+	for (i = 1; i < NELEMS(process); i++) {
+		struct record *r = &table->rec[i];
+		struct supervisor *p = &process[i];
+		int64_t left;
+
+		if (!r->pid)
+			continue;
+
+		if ((int)i != r->id || (kill(r->pid, 0) && errno != EPERM) ||
+		    !r->start || starttime(r->pid) != r->start) {
+			DEBUG("Dropping stale subscriber %s[%d]", r->label, r->pid);
+			erase(i);
+			continue;
+		}
+
+		p->id        = r->id;
+		p->pid       = r->pid;
+		p->timeout   = r->timeout;
+		p->ack       = r->ack;
+		p->floor     = r->floor;
+		p->window    = r->window;
+		p->budget    = r->budget;
+		p->slo_window  = r->slo_window;
+		p->slo_periods = r->slo_periods;
+		if (r->nstage >= 0 && r->nstage <= WDOG_STAGE_MAX) {
+			p->nstage = r->nstage;
+			memcpy(p->stage, r->stage, sizeof(p->stage));
+		}
+		p->cur       = p->nstage;
+		p->last_kick = now;
+		strlcpy(p->label, r->label, sizeof(p->label));
+		p->rec = history_get(p->label);
+
+		left = r->deadline - now;
+		if (left < p->timeout + 500)
+			left = p->timeout + 500;
+
+		INFO("Adopting %s[%d] id:%d, deadline in %d msec", p->label, p->pid, p->id, (int)left);
+		uev_timer_init(ctx, &p->watcher, timeout_cb, p, (int)left, (int)left);
+		arm(p, (int)left);
+		watch(ctx, p);
+
+		r->group[sizeof(r->group) - 1] = 0;
+		if (r->group[0] && join(ctx, p, r->group, r->quorum))
+			PERROR("Failed re-joining %s[%d] to group %s", p->label, p->pid, r->group);
+		save(p);
+	}
+}
+
 int supervisor_init(uev_ctx_t *ctx, int enabled, int realtime, char *script)
 {
 	static int already = 0;
 	size_t i;
 
-	/* XXX: Maybe store these in shm instead, in case we are restarted? */
 	for (i = 0; !already && i < NELEMS(process); i++) {
 		memset(&process[i], 0, sizeof(struct supervisor));
 		process[i].id = -1;
+		process[i].pidfd = process[i].schedfd = -1;
 	}
 	already = 1;
 
@@ -483,6 +1489,40 @@ int supervisor_init(uev_ctx_t *ctx, int enabled, int realtime, char *script)
 	supervisor_realtime = realtime;
 	set_priority(1, realtime);
 
+	if (!table)
+		adopt(ctx);
+
+	return 0;
+}
+
+/*
+ * Soft deadline, @level is the fraction (0.0-1.0) of the timeout that
+ * may elapse without a kick before a warning is issued.  Zero disables.
+ */
+int supervisor_warning(float level, char *script)
+{
+	warning = level;
+
+	if (warn_exec)
+		free(warn_exec);
+	warn_exec = NULL;
+
+	if (script) {
+		if (access(script, X_OK)) {
+			ERROR("%s is not executable.", script);
+			return -1;
+		}
+		warn_exec = strdup(script);
+	}
+
+	return 0;
+}
+
+/* Kick cadence drift threshold, in standard deviations, zero disables */
+int supervisor_drift(float sigma)
+{
+	drift = sigma;
+
 	return 0;
 }
 
@@ -493,13 +1533,28 @@ int supervisor_exit(uev_ctx_t *ctx)
 	if (!supervisor_enabled)
 		return 0;
 
+	/* Keep subscriber table for the next instance of watchdogd */
 	for (i = 0; i < NELEMS(process); i++) {
-		if (process[i].id != -1) {
-			uev_timer_stop(&process[i].watcher);
+		struct supervisor *p = &process[i];
 
-			memset(&process[i], 0, sizeof(struct supervisor));
-			process[i].id = -1;
-		}
+		if (p->id == -1)
+			continue;
+
+		uev_timer_stop(&p->watcher);
+		unwatch(p);
+		history_put(p->rec);
+		memset(p, 0, sizeof(*p));
+		p->id = -1;
+		p->pidfd = p->schedfd = -1;
+	}
+	history_flush();
+
+	for (i = 0; i < NELEMS(group); i++) {
+		if (!group[i].name[0])
+			continue;
+
+		uev_timer_stop(&group[i].watcher);
+		memset(&group[i], 0, sizeof(group[i]));
 	}
 
 	set_priority(0, 0);
@@ -523,10 +1578,25 @@ int supervisor_enable(int enable)
 			      enable ? "En" : "Dis", p->label, p->id);
 			if (!enable)
 				result += uev_timer_stop(&p->watcher);
-			else
-				result += uev_timer_set(&p->watcher,
-							p->timeout, p->timeout);
+			else if (!p->grp)
+				result += arm(p, p->timeout);
+			save(p);
+		}
+	}
+
+	for (i = 0; i < NELEMS(group); i++) {
+		struct group *g = &group[i];
+
+		if (!g->name[0])
+			continue;
+
+		if (!enable) {
+			result += uev_timer_stop(&g->watcher);
+			continue;
 		}
+
+		g->deadline = wdt_msec() + g->timeout;
+		result += uev_timer_set(&g->watcher, g->timeout, g->timeout);
 	}
 
 	set_priority(enable, supervisor_realtime);
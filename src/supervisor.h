@@ -21,8 +21,13 @@
 int supervisor_init         (uev_ctx_t *ctx, int enabled, int realtime, char *script);
 int supervisor_exit         (uev_ctx_t *ctx);
 
+int supervisor_warning      (float level, char *script);
+int supervisor_drift        (float sigma);
+
 int supervisor_enable       (int enable);
-int supervisor_list_clients (int sd);
+int supervisor_list_clients (int sd, int cmd);
+
+unsigned int supervisor_load (unsigned int *tmo);
 
 #endif /* WDOG_SUPERVISOR_H_ */
 
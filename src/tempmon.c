@@ -18,6 +18,7 @@
 #include <libgen.h>
 #include <sys/statvfs.h>
 #include "wdt.h"
+#include "lagmon.h"
 #include "script.h"
 
 #define HWMON_PATH    "/sys/class/hwmon/"
@@ -158,9 +159,8 @@ static float calc_mean(struct temp *sensor)
 	return mean / valid;
 }
 
-static void cb(uev_t *w, void *arg, int events)
+static void check(uev_t *w, struct temp *sensor)
 {
-	struct temp *sensor = (struct temp *)arg;
 	const char *nm = sensor->name;
 	float temp, mean, trip, crit;
 
@@ -198,6 +198,15 @@ static void cb(uev_t *w, void *arg, int events)
 
 }
 
+static void cb(uev_t *w, void *arg, int events)
+{
+	struct temp *sensor = (struct temp *)arg;
+
+	lagmon_enter("tempmon", sensor->name);
+	check(w, sensor);
+	lagmon_leave();
+}
+
 static int sanity_check(const char *path, float *temp)
 {
 	float tmp = read_temp(path);
@@ -0,0 +1,340 @@
+/* In-process thread supervisor, for embedding in applications
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Same semantics as the process supervisor in watchdogd, but for the
+ * threads of a single application.  Threads subscribe with a timeout in
+ * microseconds and kick with an ack, like wdog_kick2().  Kicking is a
+ * clock read and two atomic operations, no system calls other than the
+ * vDSO clock, no locks.
+ *
+ * A checker thread sleeps until the earliest deadline, and sends one
+ * aggregated heartbeat to watchdogd for the whole application, as long
+ * as all threads are healthy.  A thread that misses its deadline, or
+ * kicks with the wrong ack, is reported to the failure callback.  If
+ * the callback returns non-zero, or there is none, the heartbeat stops
+ * and watchdogd takes action when the application's timeout expires.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "wdog.h"
+
+enum {
+	SLOT_FREE = 0,
+	SLOT_RESERVED,
+	SLOT_ACTIVE,
+	SLOT_FAILED,
+	SLOT_DEAD,		/* Failure reported, heartbeat stopped */
+};
+
+static struct slot {
+	int          state;	/* SLOT_*, atomic */
+	unsigned int ack;	/* Next expected ack, atomic */
+	uint64_t     deadline;	/* Monotonic nsec, atomic */
+	uint64_t     timeout;	/* nsec */
+	char         label[48];
+} slot[WDOG_THREAD_MAX];
+
+static int (*fail_cb)(int, const char *, void *);
+static void *fail_arg;
+
+static pthread_t       checker;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cond;
+static int             running;
+static int             pending;	/* Wakeup while not waiting */
+static int             failed;	/* Heartbeat stopped */
+
+static int             wid = -1;
+static unsigned int    wack;
+static uint64_t        heartbeat;	/* nsec */
+
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Wake up checker, a new deadline may be earlier than the current */
+static void wakeup(void)
+{
+	pthread_mutex_lock(&lock);
+	pending = 1;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+static struct slot *get(int id)
+{
+	if (id < 0 || id >= WDOG_THREAD_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return &slot[id];
+}
+
+/*
+ * Report failed thread, on non-zero return the heartbeat stops.  Called
+ * without the lock held, so the callback may use this API.
+ */
+static void report(int id)
+{
+	struct slot *s = &slot[id];
+	int rc = 1;
+
+	if (fail_cb)
+		rc = fail_cb(id, s->label, fail_arg);
+
+	if (rc) {
+		failed = 1;
+		__atomic_store_n(&s->state, SLOT_DEAD, __ATOMIC_RELEASE);
+	} else
+		__atomic_store_n(&s->state, SLOT_FREE, __ATOMIC_RELEASE);
+}
+
+static void *check(void *arg)
+{
+	uint64_t beat = 0;
+
+	(void)arg;
+
+	pthread_mutex_lock(&lock);
+	while (running) {
+		uint64_t t, next;
+		struct timespec ts;
+		int i;
+
+		pending = 0;
+		pthread_mutex_unlock(&lock);
+
+		t = now();
+		if (!failed && t >= beat) {
+			if (wdog_kick2(wid, &wack))
+				beat = t + heartbeat / 4; /* Retry sooner */
+			else
+				beat = t + heartbeat;
+		}
+		/* Heartbeat stopped, only wake up for slot deadlines */
+		next = failed ? t + heartbeat : beat;
+
+		for (i = 0; i < WDOG_THREAD_MAX; i++) {
+			struct slot *s = &slot[i];
+			int state = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+			uint64_t deadline;
+
+			if (state == SLOT_FAILED) {
+				report(i);
+				continue;
+			}
+			if (state != SLOT_ACTIVE)
+				continue;
+
+			deadline = __atomic_load_n(&s->deadline, __ATOMIC_ACQUIRE);
+			if (deadline > t) {
+				if (deadline < next)
+					next = deadline;
+				continue;
+			}
+
+			/* Lost the race with an ack failure or unsubscribe */
+			if (!__atomic_compare_exchange_n(&s->state, &state, SLOT_FAILED, 0,
+							 __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+				continue;
+			report(i);
+		}
+
+		ts.tv_sec  = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+
+		pthread_mutex_lock(&lock);
+		if (running && !pending)
+			pthread_cond_timedwait(&cond, &lock, &ts);
+	}
+	pthread_mutex_unlock(&lock);
+
+	return NULL;
+}
+
+int wdog_thread_init(char *label, unsigned int timeout, int (*cb)(int, const char *, void *), void *arg)
+{
+	pthread_condattr_t attr;
+	int rc;
+
+	if (running) {
+		errno = EALREADY;
+		return -errno;
+	}
+
+	wid = wdog_subscribe(label, timeout, &wack);
+	if (wid < 0)
+		return wid;
+
+	heartbeat = (uint64_t)timeout * 1000000ULL / 2;
+	fail_cb   = cb;
+	fail_arg  = arg;
+	failed    = 0;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	running = 1;
+	rc = pthread_create(&checker, NULL, check, NULL);
+	if (rc) {
+		running = 0;
+		wdog_unsubscribe(wid, wack);
+		wid = -1;
+		errno = rc;
+		return -errno;
+	}
+
+	return 0;
+}
+
+int wdog_thread_exit(void)
+{
+	if (!running) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	pthread_mutex_lock(&lock);
+	running = 0;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+	pthread_join(checker, NULL);
+	pthread_cond_destroy(&cond);
+
+	memset(slot, 0, sizeof(slot));
+
+	return wdog_unsubscribe(wid, wack);
+}
+
+int wdog_thread_subscribe(char *label, unsigned int timeout, unsigned int *ack)
+{
+	int i;
+
+	if (!ack || !timeout) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	for (i = 0; i < WDOG_THREAD_MAX; i++) {
+		struct slot *s = &slot[i];
+		int state = SLOT_FREE;
+
+		if (!__atomic_compare_exchange_n(&s->state, &state, SLOT_RESERVED, 0,
+						 __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			continue;
+
+		if (label)
+			snprintf(s->label, sizeof(s->label), "%s", label);
+		else
+			snprintf(s->label, sizeof(s->label), "thread%d", i);
+		s->timeout = (uint64_t)timeout * 1000ULL;
+		__atomic_store_n(&s->deadline, now() + s->timeout, __ATOMIC_RELAXED);
+		__atomic_store_n(&s->ack, s->ack + 2, __ATOMIC_RELAXED);
+		*ack = s->ack;
+		__atomic_store_n(&s->state, SLOT_ACTIVE, __ATOMIC_RELEASE);
+
+		wakeup();
+		return i;
+	}
+
+	errno = ENOMEM;
+	return -errno;
+}
+
+int wdog_thread_unsubscribe(int id, unsigned int ack)
+{
+	struct slot *s;
+	int state = SLOT_ACTIVE;
+
+	s = get(id);
+	if (!s)
+		return -errno;
+
+	if (__atomic_load_n(&s->ack, __ATOMIC_ACQUIRE) != ack) {
+		errno = EBADMSG;
+		return -errno;
+	}
+
+	/* A thread reported dead may still unsubscribe */
+	if (!__atomic_compare_exchange_n(&s->state, &state, SLOT_FREE, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) &&
+	    (state != SLOT_DEAD ||
+	     !__atomic_compare_exchange_n(&s->state, &state, SLOT_FREE, 0,
+					  __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	return 0;
+}
+
+int wdog_thread_kick(int id, unsigned int *ack)
+{
+	unsigned int expected;
+	struct slot *s;
+	int state;
+
+	s = get(id);
+	if (!s || !ack) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) != SLOT_ACTIVE) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	expected = *ack;
+	if (!__atomic_compare_exchange_n(&s->ack, &expected, expected + 2, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+		/* Same as a failed kick in the process supervisor */
+		state = SLOT_ACTIVE;
+		if (__atomic_compare_exchange_n(&s->state, &state, SLOT_FAILED, 0,
+						__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			wakeup();
+		errno = EBADMSG;
+		return -errno;
+	}
+
+	__atomic_store_n(&s->deadline, now() + s->timeout, __ATOMIC_RELEASE);
+	*ack = expected + 2;
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "linux"
+ *  indent-tabs-mode: t
+ * End:
+ */
@@ -145,6 +145,260 @@ static int do_list_clients(char *arg)
 	return 0;
 }
 
+static int do_stats(char *arg)
+{
+	wdog_stats_t *stats = NULL;
+	int count, i;
+
+	(void)arg;  /* Unused */
+
+	count = wdog_client_stats(&stats);
+	if (count < 0) {
+		perror("Failed to get client statistics");
+		return 1;
+	}
+
+	if (count == 0) {
+		if (json)
+			printf("[]\n");
+		else
+			printf("No subscribed clients.\n");
+		return 0;
+	}
+
+	if (json) {
+		printf("[\n");
+		for (i = 0; i < count; i++) {
+			if (i > 0)
+				printf(",\n");
+			printf("  {\n");
+			printf("    \"id\": %d,\n", stats[i].id);
+			printf("    \"pid\": %d,\n", stats[i].pid);
+			printf("    \"label\": \"%s\",\n", stats[i].label);
+			printf("    \"timeout\": %u,\n", stats[i].timeout);
+			printf("    \"kicks\": %u,\n", stats[i].kicks);
+			printf("    \"interval\": {\n");
+			printf("      \"p50\": %u,\n", stats[i].interval_p50);
+			printf("      \"p99\": %u,\n", stats[i].interval_p99);
+			printf("      \"max\": %u\n", stats[i].interval_max);
+			printf("    },\n");
+			printf("    \"margin_min\": %d,\n", stats[i].margin_min);
+			printf("    \"near_misses\": %u,\n", stats[i].near_misses);
+			printf("    \"rate\": %u,\n", stats[i].rate);
+			printf("    \"latency_p99\": %u,\n", stats[i].latency_p99);
+			printf("    \"drifts\": %u\n", stats[i].drifts);
+			printf("  }");
+		}
+		printf("\n]\n");
+	} else {
+		printf("\033[7mID   NAME                   PID    KICKS    P50 ms    P99 ms    MAX ms  MARGIN ms  NEAR  RATE/s  LAT us DRIFT\033[0m\n");
+		for (i = 0; i < count; i++) {
+			printf("%-4d %-20s %6d %8u %9u %9u %9u ",
+			       stats[i].id, stats[i].label, stats[i].pid, stats[i].kicks,
+			       stats[i].interval_p50, stats[i].interval_p99, stats[i].interval_max);
+			if (stats[i].kicks)
+				printf("%10d ", stats[i].margin_min);
+			else
+				printf("%10s ", "-");
+			printf("%5u %7u %7u %5u\n", stats[i].near_misses,
+			       stats[i].rate, stats[i].latency_p99, stats[i].drifts);
+		}
+	}
+
+	free(stats);
+	return 0;
+}
+
+static void secs(int sec)
+{
+	if (sec < 0)
+		printf(" %9s", "-");
+	else
+		printf(" %5d sec", sec);
+}
+
+static int do_devices(char *arg)
+{
+	wdog_device_t *devs = NULL;
+	int count, i;
+
+	(void)arg;  /* Unused */
+
+	count = wdog_devices(&devs);
+	if (count < 0) {
+		perror("Failed to get devices");
+		return 1;
+	}
+
+	if (json) {
+		printf("[\n");
+		for (i = 0; i < count; i++) {
+			if (i > 0)
+				printf(",\n");
+			printf("  {\n");
+			printf("    \"name\": \"%s\",\n", devs[i].name);
+			printf("    \"timeout\": %u,\n", devs[i].timeout);
+			printf("    \"interval\": %u,\n", devs[i].interval);
+			printf("    \"time_left\": %d,\n", devs[i].timeleft);
+			printf("    \"time_left_min\": %d,\n", devs[i].timeleft_min);
+			printf("    \"adaptive\": %d,\n", devs[i].adaptive);
+			printf("    \"wakeups\": %u,\n", devs[i].wakeups);
+			printf("    \"lateness\": {\n");
+			printf("      \"p50\": %u,\n", devs[i].late_p50);
+			printf("      \"p99\": %u,\n", devs[i].late_p99);
+			printf("      \"max\": %u\n", devs[i].late_max);
+			printf("    },\n");
+			printf("    \"failures\": %u,\n", devs[i].failures);
+			printf("    \"kick_latency\": {\n");
+			printf("      \"p99\": %u,\n", devs[i].kick_p99);
+			printf("      \"max\": %u\n", devs[i].kick_max);
+			printf("    },\n");
+			printf("    \"standby\": %s\n", devs[i].standby ? "true" : "false");
+			printf("  }");
+		}
+		printf("%s]\n", count ? "\n" : "");
+	} else {
+		printf("\033[7mNAME                    TIMEOUT    INTERVAL  TIME-LEFT   MIN-LEFT   ADAPTIVE   LATE p99   LATE MAX  FAILS\033[0m\n");
+		for (i = 0; i < count; i++) {
+			printf("%-20s %8u ms %8u ms", devs[i].name, devs[i].timeout, devs[i].interval);
+			secs(devs[i].timeleft);
+			secs(devs[i].timeleft_min);
+			secs(devs[i].adaptive ? devs[i].adaptive : -1);
+			printf(" %7.1f ms %7.1f ms", devs[i].late_p99 / 1000.0, devs[i].late_max / 1000.0);
+			printf(" %6u%s\n", devs[i].failures, devs[i].standby ? " (standby)" : "");
+		}
+	}
+
+	free(devs);
+	return 0;
+}
+
+static const char *policy(int pol)
+{
+	switch (pol) {
+	case SCHED_OTHER:
+		return "SCHED_OTHER";
+	case SCHED_FIFO:
+		return "SCHED_FIFO";
+	case SCHED_RR:
+		return "SCHED_RR";
+#ifdef SCHED_BATCH
+	case SCHED_BATCH:
+		return "SCHED_BATCH";
+#endif
+#ifdef SCHED_IDLE
+	case SCHED_IDLE:
+		return "SCHED_IDLE";
+#endif
+	case SCHED_DEADLINE:
+		return "SCHED_DEADLINE";
+	}
+
+	return "unknown";
+}
+
+static int do_realtime(char *arg)
+{
+	wdog_realtime_t rt;
+
+	(void)arg;  /* Unused */
+
+	if (wdog_realtime(&rt)) {
+		perror("Failed to get real-time status");
+		return 1;
+	}
+
+	if (json) {
+		printf("{\n");
+		printf("  \"policy\": \"%s\",\n", policy(rt.policy));
+		printf("  \"priority\": %d,\n", rt.priority);
+		printf("  \"runtime\": %u,\n", rt.runtime);
+		printf("  \"deadline\": %u,\n", rt.deadline);
+		printf("  \"period\": %u,\n", rt.period);
+		printf("  \"cpus\": \"%s\",\n", rt.cpus);
+		printf("  \"locked\": %s,\n", rt.locked ? "true" : "false");
+		printf("  \"stack_kib\": %u,\n", rt.stack_kib);
+		printf("  \"heap_kib\": %u,\n", rt.heap_kib);
+		printf("  \"page_faults\": {\n");
+		printf("    \"minor\": %llu,\n", rt.minflt);
+		printf("    \"major\": %llu,\n", rt.majflt);
+		printf("    \"minor_locked\": %llu,\n", rt.minflt_locked);
+		printf("    \"major_locked\": %llu\n", rt.majflt_locked);
+		printf("  }\n");
+		printf("}\n");
+		return 0;
+	}
+
+	printf("Scheduler      : %s", policy(rt.policy));
+	if (rt.priority)
+		printf(", priority %d", rt.priority);
+	if (rt.policy == SCHED_DEADLINE)
+		printf(", runtime %u us, deadline %u us, period %u us",
+		       rt.runtime, rt.deadline, rt.period);
+	printf("\nCPU affinity   : %s\n", rt.cpus[0] ? rt.cpus : "N/A");
+	if (rt.locked)
+		printf("Memory locked  : yes, prefaulted %u KiB stack, %u KiB heap\n",
+		       rt.stack_kib, rt.heap_kib);
+	else
+		printf("Memory locked  : no\n");
+	printf("Page faults    : %llu minor, %llu major\n", rt.minflt, rt.majflt);
+	if (rt.locked)
+		printf("  since locked : %llu minor, %llu major\n",
+		       rt.minflt_locked, rt.majflt_locked);
+
+	return 0;
+}
+
+static int do_history(char *arg)
+{
+	wdog_history_t *hist = NULL;
+	char buf[32];
+	int count, i;
+
+	(void)arg;  /* Unused */
+
+	count = wdog_history(&hist);
+	if (count < 0) {
+		perror("Failed to get statistics, check the statistics setting in watchdogd.conf");
+		return 1;
+	}
+
+	if (json) {
+		printf("[\n");
+		for (i = 0; i < count; i++) {
+			if (i > 0)
+				printf(",\n");
+			printf("  {\n");
+			printf("    \"label\": \"%s\",\n", hist[i].label);
+			printf("    \"starts\": %u,\n", hist[i].starts);
+			printf("    \"kicks\": %llu,\n", hist[i].kicks);
+			printf("    \"misses\": %u,\n", hist[i].misses);
+			printf("    \"near_misses\": %u,\n", hist[i].near_misses);
+			printf("    \"margin_min\": %d,\n", hist[i].margin_min);
+			printf("    \"last_seen\": %lld\n", (long long)hist[i].last_seen);
+			printf("  }");
+		}
+		printf("%s]\n", count ? "\n" : "");
+	} else if (!count) {
+		printf("No statistics recorded.\n");
+	} else {
+		printf("\033[7mNAME                   STARTS        KICKS  MISSES  NEAR  MARGIN ms  LAST SEEN          \033[0m\n");
+		for (i = 0; i < count; i++) {
+			strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&hist[i].last_seen));
+			printf("%-20s %8u %12llu %7u %5u ", hist[i].label, hist[i].starts,
+			       hist[i].kicks, hist[i].misses, hist[i].near_misses);
+			if (hist[i].kicks)
+				printf("%10d ", hist[i].margin_min);
+			else
+				printf("%10s ", "-");
+			printf(" %s\n", buf);
+		}
+	}
+
+	free(hist);
+	return 0;
+}
+
 static int parse_code(char *arg)
 {
 	const char *errstr;
@@ -161,11 +415,14 @@ static int parse_code(char *arg)
 		       "  7   Failed, unknown\n"
 		       "  8   File descriptor leak\n"
 		       "  9   Memory leak\n"
-		       "  10  CPU overload\n");
+		       "  10  CPU overload\n"
+		       "  11  PID starved of CPU\n"
+		       "  12  PID blocked\n"
+		       "  13  PID spinning\n");
 		exit(1);
 	}
 
-	rc = strtonum(arg, 1, 10, &errstr);
+	rc = strtonum(arg, 1, 13, &errstr);
 	if (errstr)
 		errx(1, "Error, reset reason code is %s", errstr);
 
@@ -219,6 +476,11 @@ static int do_reload(char *Arg)
 	return wdog_reload();
 }
 
+static int do_upgrade(char *arg)
+{
+	return wdog_upgrade();
+}
+
 static int do_debug(char *arg)
 {
 	int result;
@@ -387,7 +649,7 @@ static int show_status(char *arg)
 	/* Parse and format output */
 	char name[64] = "", identity[64] = "", reason[64] = "", label[64] = "", date[64] = "";
 	char cap_flags[256] = "", reset_flags[256] = "";
-	int timeout = 0, interval = 0, safe_exit = 0, reset_code = 0, reset_count = 0;
+	int timeout = 0, interval = 0, interval_ms = -1, safe_exit = 0, reset_code = 0, reset_count = 0;
 	int pid = 0;
 
 	/* Extract device info */
@@ -395,6 +657,7 @@ static int show_status(char *arg)
 	extract_string(content, "\"identity\"", identity, sizeof(identity));
 	extract_int(content, "\"timeout\"", &timeout);
 	extract_int(content, "\"interval\"", &interval);
+	extract_int(content, "\"interval-ms\"", &interval_ms); /* optional */
 	extract_bool(content, "\"safe-exit\"", &safe_exit);
 
 	/* Extract capability flags */
@@ -436,7 +699,10 @@ static int show_status(char *arg)
 	printf("Device         : %s\n", name[0] ? name : "N/A");
 	printf("Identity       : %s\n", identity[0] ? identity : "N/A");
 	printf("Timeout        : %d sec\n", timeout);
-	printf("Interval       : %d sec\n", interval);
+	if (interval_ms >= 0 && interval_ms % 1000)
+		printf("Interval       : %d ms\n", interval_ms);
+	else
+		printf("Interval       : %d sec\n", interval);
 	printf("Safe Exit      : %s\n", safe_exit ? "yes" : "no");
 
 	if (cap_flags[0] && cap_flags[0] != '{') {
@@ -646,14 +912,19 @@ static int usage(int code)
 	       "                       Use `-p PID` option to perform reset as PID\n"
 	       "  reload               Reload daemon configuration file, like SIGHUP\n"
 	       "  status               Show watchdog and supervisor status, default command\n"
+	       "  upgrade              Re-exec watchdogd binary, without closing the WDT\n"
 	       "  version              Show program version\n"
 		"\n"
 	       "  clear                Clear reset reason\n"
 	       "  counter              Show reset counter, num. reboots since power-on\n"
 		"\n"
+	       "  devices              Show watchdog devices and time left before reset\n"
 	       "  disable              Disable watchdog\n"
 	       "  enable               Re-enable watchdog\n"
 	       "  list-clients         List subscribed clients\n"
+	       "  stats                Show kick interval and deadline margin of clients\n"
+	       "  history              Show persistent per-label statistics, across reboots\n"
+	       "  realtime             Show scheduling, memory locking, and page faults\n"
 		"\n"
 #ifdef TEST_MODE
 	       "  test    [TEST]       Run process supervisor built-in test, see below\n"
@@ -699,10 +970,12 @@ int main(int argc, char *argv[])
 	struct command command[] = {
 		{ "clear",             do_clear,     NULL },
 		{ "counter",           do_counter,   NULL },
+		{ "devices",           do_devices,   NULL },
 		{ "disable",           do_enable,    "0"  },
 		{ "enable",            do_enable,    "1"  },
 		{ "list-clients",      do_list_clients, NULL},
 		{ "help",              show_usage,   NULL },
+		{ "history",           do_history,   NULL },
 		{ "debug",             do_debug,     NULL },
 		{ "loglevel",          set_loglevel, NULL },
 		{ "failed",            do_failed,    NULL },
@@ -710,10 +983,13 @@ int main(int argc, char *argv[])
 		{ "reset",             do_reset,     NULL },
 		{ "force-reset",       do_reset,     NULL },
 		{ "reload",            do_reload,    NULL },
+		{ "realtime",          do_realtime,  NULL },
 		{ "status",            show_status,  NULL },
+		{ "stats",             do_stats,     NULL },
 #ifdef TEST_MODE
 		{ "test",              run_test,     NULL },
 #endif
+		{ "upgrade",           do_upgrade,   NULL },
 		{ "version",           show_version, NULL },
 		{ NULL,                NULL,         NULL }
 	};
@@ -20,6 +20,8 @@
 #include "wdt.h"
 #include "api.h"
 #include "conf.h"
+#include "lagmon.h"
+#include "reexec.h"
 #include "script.h"
 #include "supervisor.h"
 
@@ -33,8 +35,12 @@ int   opt_interval = 0;
 int magic   = 0;
 int enabled = 1;
 int loglevel = LOG_NOTICE;
-int period = WDT_KICK_DEFAULT;
+int period = WDT_KICK_DEFAULT * 1000;
 int timeout = WDT_TIMEOUT_DEFAULT;
+int pretimeout = 0;
+int adaptive = 0;
+int kick_failures = 0;
+int health_gated = 0;
 int rebooting = 0;
 int wait_reboot = 0;
 char  *prognm = NULL;
@@ -91,13 +97,14 @@ static void reboot_cb(uev_t *w, void *arg, int events)
 static void reload_cb(uev_t *w, void *arg, int events)
 {
 	INFO("SIGHUP received, reloading %s", opt_config ?: "nothing");
-	if (conf_parse_file(w->ctx, opt_config))
-		return;
-
-	wdt_init(w->ctx, NULL);
+	lagmon_enter("reload", NULL);
+	if (!conf_parse_file(w->ctx, opt_config)) {
+		wdt_init(w->ctx, NULL);
 
-	/* Touch PID file to tell Finit we're done with HUP */
-	pidfile_touch();
+		/* Touch PID file to tell Finit we're done with HUP */
+		pidfile_touch();
+	}
+	lagmon_leave();
 }
 
 static void ignore_cb(uev_t *w, void *arg, int events)
@@ -145,7 +152,7 @@ static char *progname(char *arg0)
 static int usage(int status)
 {
 	printf("Usage:\n"
-	       "  %s [-hnsVx] [-f FILE] [-T SEC] [-t SEC] [%s]\n\n"
+	       "  %s [-hnsVx] [-f FILE] [-T SEC] [-t TIME] [%s]\n\n"
 	       "Example:\n"
 	       "  %s -T 120 -t 30 /dev/watchdog2\n\n"
                "Options:\n"
@@ -155,7 +162,8 @@ static int usage(int status)
 	       "  -l, --loglevel=LVL  Log level: none, err, warn, notice*, info, debug\n"
 	       "\n"
                "  -T, --timeout=SEC   Watchdog timer (WDT) timeout, in seconds, default: %d\n"
-               "  -t, --interval=SEC  WDT kick interval, in seconds, default: %d\n"
+               "  -t, --interval=TIME WDT kick interval, in seconds, or ms, e.g. 250ms,\n"
+	       "                      default: %d\n"
                "  -x, --safe-exit     Disable watchdog on exit from SIGINT/SIGTERM,\n"
 	       "                      \"magic\" exit may not be supported by HW/driver\n"
 	       "\n"
@@ -201,6 +209,7 @@ int main(int argc, char *argv[])
 		{"loglevel",      1, 0, 'l'},
 		{"safe-exit",     0, 0, 'x'},
 		{"syslog",        0, 0, 's'},
+		{"takeover",      1, 0, 'R'}, /* Hidden, used by upgrade */
 #ifdef TEST_MODE
 		{"test-mode",     0, 0, 'S'}, /* Hidden test mode, not for public use. */
 #endif
@@ -210,12 +219,14 @@ int main(int argc, char *argv[])
 	};
 	int background = 1;
 	int use_syslog = 1;
+	int takeover = -1;
 	char devnode[256];
 	char *dev = NULL;
 	int c, status;
 	uev_ctx_t ctx;
 
 	prognm = progname(argv[0]);
+	reexec_init(argc, argv);
 	while ((c = getopt_long(argc, argv, "f:Fhl:LnsSt:T:Vx?", long_options, NULL)) != EOF) {
 		switch (c) {
 		case 'f':
@@ -237,6 +248,10 @@ int main(int argc, char *argv[])
 			use_syslog--;
 			break;
 
+		case 'R':	/* Upgrade, take over from previous instance */
+			takeover = atoi(optarg);
+			break;
+
 		case 's':
 			use_syslog++;
 			break;
@@ -252,7 +267,11 @@ int main(int argc, char *argv[])
 				fprintf(stderr, "Missing interval argument.\n");
 				return usage(1);
 			}
-			opt_interval = atoi(optarg);
+			opt_interval = wdt_interval(optarg);
+			if (opt_interval <= 0) {
+				fprintf(stderr, "Invalid interval '%s', e.g. 10 or 250ms.\n", optarg);
+				return usage(1);
+			}
 			break;
 
 		case 'T':	/* Watchdog timeout */
@@ -316,8 +335,8 @@ int main(int argc, char *argv[])
 	if (opt_interval)
 		period = opt_interval;
 
-	/* Start daemon */
-	if (background) {
+	/* Start daemon, unless we're already one: keep PID on upgrade */
+	if (background && takeover == -1) {
 		DEBUG("Daemonizing ...");
 
 		if (-1 == daemon(0, 0)) {
@@ -339,6 +358,17 @@ int main(int argc, char *argv[])
 	else
 		mkpath(WDOG_STATUSDIR, 0755);
 
+	/*
+	 * Receive WDT and API descriptors from previous instance.  On
+	 * failure the upgrade helper still holds the WDT, so we cannot
+	 * open it.  Exit, the helper stops kicking when we are gone and
+	 * we are restarted by init, or the system is reset.
+	 */
+	if (takeover != -1 && reexec_adopt(takeover)) {
+		ERROR("Failed taking over from previous instance, exiting.");
+		return 1;
+	}
+
 	/* Read /etc/watchdogd.conf if it exists */
 	conf_parse_file(&ctx, opt_config);
 
@@ -359,6 +389,9 @@ int main(int argc, char *argv[])
 	/* Start client API socket */
 	api_init(&ctx);
 
+	/* All set, release previous instance's upgrade helper */
+	reexec_done();
+
 	/* Create pidfile when we're done with all set up. */
 	pidfile_touch();
 
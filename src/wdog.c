@@ -111,63 +111,84 @@ error:
 	return 1;
 }
 
-static int doit(int cmd, int id, char *label, unsigned int timeout, unsigned int *ack)
+static void init(wdog_t *req, int cmd, int id, char *label)
 {
-	wdog_t req = {
-		.cmd     = cmd,
-		.pid     = getpid(),
-		.timeout = timeout,
-	};
 	size_t len;
-	int sd;
 
-	sd = api_init();
-	if (-1 == sd) {
-		if (errno == ENOENT)
-			errno = EAGAIN;
-		return -errno;
-	}
+	memset(req, 0, sizeof(*req));
+	req->cmd = cmd;
+	req->id  = id;
+	req->pid = getpid();
 
 	if (!label || !label[0])
 		label = __progname;
 
 	/* Copy label and make sure to terminate it. */
 	len = strlen(label);
-	if (len >= sizeof(req.label))
-		len = sizeof(req.label) - 1;
-	strncpy(req.label, label, sizeof(req.label));
-	req.label[len] = 0;
+	if (len >= sizeof(req->label))
+		len = sizeof(req->label) - 1;
+	strncpy(req->label, label, sizeof(req->label));
+	req->label[len] = 0;
+}
 
-	switch (cmd) {
-	case WDOG_KICK_CMD:
-	case WDOG_UNSUBSCRIBE_CMD:
-		req.id  = id;
-		req.ack = *ack;
-		break;
+/* Send request and wait for reply, returns 0 or -errno */
+static int request(wdog_t *req)
+{
+	int sd;
 
-	default:
-		req.id = id;
-		break;
+	sd = api_init();
+	if (-1 == sd) {
+		if (errno == ENOENT)
+			errno = EAGAIN;
+		return -errno;
 	}
 
 	if (api_poll(sd, POLLOUT)) {
-		if (write(sd, &req, sizeof(req)) != sizeof(req))
+		if (write(sd, req, sizeof(*req)) != sizeof(*req))
 			goto error;
 	} else
 		goto error;
 
 	if (api_poll(sd, POLLIN)) {
-		if (read(sd, &req, sizeof(req)) != sizeof(req))
+		if (read(sd, req, sizeof(*req)) != sizeof(*req))
 			goto error;
 	} else
 		goto error;
 
-	if (req.cmd == WDOG_CMD_ERROR) {
-		errno = req.error;
+	if (req->cmd == WDOG_CMD_ERROR) {
+		errno = req->error;
 		goto error;
 	}
 	close(sd);
 
+	return 0;
+error:
+	close(sd);
+	return -errno;
+}
+
+static int doit(int cmd, int id, char *label, unsigned int timeout, unsigned int *ack)
+{
+	wdog_t req;
+	int rc;
+
+	init(&req, cmd, id, label);
+	req.timeout = timeout;
+
+	switch (cmd) {
+	case WDOG_KICK_CMD:
+	case WDOG_UNSUBSCRIBE_CMD:
+		req.ack = *ack;
+		break;
+
+	default:
+		break;
+	}
+
+	rc = request(&req);
+	if (rc)
+		return rc;
+
 	if (ack) {
 		wdog_reason_t *reason = (wdog_reason_t *)ack;
 
@@ -187,9 +208,6 @@ static int doit(int cmd, int id, char *label, unsigned int timeout, unsigned int
 		return req.id;
 
 	return 0;
-error:
-	close(sd);
-	return -errno;
 }
 
 int wdog_subscribe(char *label, unsigned int timeout, unsigned int *ack)
@@ -218,22 +236,166 @@ int wdog_kick2(int id, unsigned int *ack)
 	return doit(WDOG_KICK_CMD, id, NULL, 0, ack);
 }
 
-int wdog_clients(wdog_client_t **clients)
+int wdog_kick_work(int id, unsigned int work, unsigned int *ack)
+{
+	wdog_t req;
+	int rc;
+
+	init(&req, WDOG_KICK_CMD, id, NULL);
+	req.ack = *ack;
+	req.kick.flags = WDOG_KICK_WORK;
+	req.kick.work  = work;
+
+	rc = request(&req);
+	if (!rc)
+		*ack = req.next_ack;
+
+	return rc;
+}
+
+int wdog_kick_latency(int id, unsigned int *usec, unsigned int num, unsigned int *ack)
+{
+	wdog_t req;
+	int rc;
+
+	init(&req, WDOG_KICK_CMD, id, NULL);
+	req.ack = *ack;
+
+	if (usec && num > 0) {
+		if (num > WDOG_LATENCY_SAMPLES) {
+			usec += num - WDOG_LATENCY_SAMPLES;
+			num   = WDOG_LATENCY_SAMPLES;
+		}
+
+		req.kick.flags = WDOG_KICK_LATENCY;
+		req.kick.count = num;
+		memcpy(req.kick.sample, usec, num * sizeof(usec[0]));
+	}
+
+	rc = request(&req);
+	if (!rc)
+		*ack = req.next_ack;
+
+	return rc;
+}
+
+int wdog_latency(int id, unsigned int budget, unsigned int window, unsigned int periods, unsigned int *ack)
+{
+	wdog_t req;
+	int rc;
+
+	init(&req, WDOG_LATENCY_CMD, id, NULL);
+	req.ack = *ack;
+	req.slo.budget  = budget;
+	req.slo.window  = window;
+	req.slo.periods = periods;
+
+	rc = request(&req);
+	if (!rc)
+		*ack = req.next_ack;
+
+	return rc;
+}
+
+int wdog_stage(int id, const char *name, unsigned int budget, unsigned int *ack)
+{
+	wdog_t req;
+	int rc;
+
+	if (!name || !name[0]) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	init(&req, WDOG_STAGE_CMD, id, NULL);
+	req.ack = *ack;
+	req.stage.budget = budget;
+	strlcpy(req.stage.name, name, sizeof(req.stage.name));
+
+	rc = request(&req);
+	if (rc)
+		return rc;
+
+	*ack = req.next_ack;
+
+	return req.stage.index;
+}
+
+int wdog_checkpoint(int id, int stage, unsigned int *ack)
+{
+	wdog_t req;
+	int rc;
+
+	init(&req, WDOG_CHECKPOINT_CMD, id, NULL);
+	req.ack = *ack;
+	req.stage.index = stage;
+
+	rc = request(&req);
+	if (!rc)
+		*ack = req.next_ack;
+
+	return rc;
+}
+
+int wdog_join(int id, const char *group, unsigned int quorum, unsigned int *ack)
+{
+	wdog_t req;
+	int rc;
+
+	if (!group || !group[0]) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	init(&req, WDOG_JOIN_CMD, id, NULL);
+	req.ack = *ack;
+	req.group.quorum = quorum;
+	strlcpy(req.group.name, group, sizeof(req.group.name));
+
+	rc = request(&req);
+	if (!rc)
+		*ack = req.next_ack;
+
+	return rc;
+}
+
+int wdog_throughput(int id, unsigned int rate, unsigned int window, unsigned int *ack)
+{
+	wdog_t req;
+	int rc;
+
+	init(&req, WDOG_THROUGHPUT_CMD, id, NULL);
+	req.ack = *ack;
+	req.floor.rate   = rate;
+	req.floor.window = window;
+
+	rc = request(&req);
+	if (!rc)
+		*ack = req.next_ack;
+
+	return rc;
+}
+
+/*
+ * Send @cmd and collect one reply per subscribed client, each reply is
+ * converted by @store into an element of size @sz in a growing array.
+ */
+static int collect(int cmd, void **array, size_t sz, void (*store)(void *, wdog_t *))
 {
 	wdog_t req = {
-		.cmd = WDOG_LIST_SUPV_CLIENTS_CMD,
+		.cmd = cmd,
 		.pid = getpid(),
 	};
-	wdog_client_t *list = NULL;
+	char *list = NULL;
 	size_t capacity = 0;
 	int sd, count = 0;
 
-	if (!clients) {
+	if (!array) {
 		errno = EINVAL;
 		return -errno;
 	}
 
-	*clients = NULL;
+	*array = NULL;
 
 	sd = api_init();
 	if (-1 == sd) {
@@ -271,24 +433,20 @@ int wdog_clients(wdog_client_t **clients)
 		/* Expand array if needed */
 		if ((size_t)count >= capacity) {
 			size_t new_capacity = capacity == 0 ? 4 : capacity * 2;
-			wdog_client_t *new_list = realloc(list, new_capacity * sizeof(wdog_client_t));
+			char *new_list = realloc(list, new_capacity * sz);
 			if (!new_list)
 				goto error;
 			list = new_list;
 			capacity = new_capacity;
 		}
 
-		/* Store client data */
-		list[count].id = req.id;
-		list[count].pid = req.pid;
-		list[count].timeout = req.timeout;
-		list[count].time_left = req.next_ack;
-		strlcpy(list[count].label, req.label, sizeof(list[count].label));
+		req.label[sizeof(req.label) - 1] = 0;
+		store(&list[count * sz], &req);
 		count++;
 	}
 
 	close(sd);
-	*clients = list;
+	*array = list;
 	return count;
 
 error:
@@ -297,6 +455,137 @@ error:
 	return -errno;
 }
 
+static void store_client(void *elem, wdog_t *req)
+{
+	wdog_client_t *client = elem;
+
+	client->id = req->id;
+	client->pid = req->pid;
+	client->timeout = req->timeout;
+	client->time_left = req->next_ack;
+	strlcpy(client->label, req->label, sizeof(client->label));
+}
+
+int wdog_clients(wdog_client_t **clients)
+{
+	return collect(WDOG_LIST_SUPV_CLIENTS_CMD, (void **)clients,
+		       sizeof(wdog_client_t), store_client);
+}
+
+static void store_stats(void *elem, wdog_t *req)
+{
+	wdog_stats_t *stats = elem;
+
+	stats->id = req->id;
+	stats->pid = req->pid;
+	stats->timeout = req->timeout;
+	stats->kicks = req->stats.kicks;
+	stats->interval_p50 = req->stats.p50;
+	stats->interval_p99 = req->stats.p99;
+	stats->interval_max = req->stats.max;
+	stats->margin_min = req->stats.margin;
+	stats->near_misses = req->stats.near_miss;
+	stats->rate = req->stats.rate;
+	stats->latency_p99 = req->stats.latency;
+	stats->drifts = req->stats.drifts;
+	strlcpy(stats->label, req->label, sizeof(stats->label));
+}
+
+int wdog_client_stats(wdog_stats_t **stats)
+{
+	return collect(WDOG_CLIENT_STATS_CMD, (void **)stats,
+		       sizeof(wdog_stats_t), store_stats);
+}
+
+static void store_history(void *elem, wdog_t *req)
+{
+	wdog_history_t *hist = elem;
+
+	strlcpy(hist->label, req->label, sizeof(hist->label));
+	hist->kicks = WDOG_U64(req->history.kicks_hi, req->history.kicks_lo);
+	hist->starts = req->history.starts;
+	hist->misses = req->history.misses;
+	hist->near_misses = req->history.near_misses;
+	hist->margin_min = req->history.margin;
+	hist->last_seen = (time_t)req->history.last;
+}
+
+int wdog_history(wdog_history_t **history)
+{
+	return collect(WDOG_HISTORY_CMD, (void **)history,
+		       sizeof(wdog_history_t), store_history);
+}
+
+static void store_device(void *elem, wdog_t *req)
+{
+	wdog_device_t *dev = elem;
+
+	strlcpy(dev->name, req->label, sizeof(dev->name));
+	dev->timeout = req->device.timeout;
+	dev->interval = req->device.interval;
+	dev->timeleft = req->device.timeleft;
+	dev->timeleft_min = req->device.margin;
+	dev->adaptive = req->device.adaptive;
+	dev->wakeups = req->device.kicks;
+	dev->late_p50 = req->device.p50;
+	dev->late_p99 = req->device.p99;
+	dev->late_max = req->device.max;
+	dev->failures = req->device.failures;
+	dev->kick_p99 = req->device.lat_p99;
+	dev->kick_max = req->device.lat_max;
+	dev->standby = req->device.standby;
+}
+
+int wdog_devices(wdog_device_t **devices)
+{
+	return collect(WDOG_DEVICES_CMD, (void **)devices,
+		       sizeof(wdog_device_t), store_device);
+}
+
+static void store_realtime(void *elem, wdog_t *req)
+{
+	wdog_realtime_t *rt = elem;
+
+	strlcpy(rt->cpus, req->label, sizeof(rt->cpus));
+	rt->policy = req->rt.policy;
+	rt->priority = req->rt.priority;
+	rt->locked = req->rt.locked;
+	rt->stack_kib = req->rt.stack;
+	rt->heap_kib = req->rt.heap;
+	rt->minflt = WDOG_U64(req->rt.minflt_hi, req->rt.minflt_lo);
+	rt->majflt = WDOG_U64(req->rt.majflt_hi, req->rt.majflt_lo);
+	rt->minflt_locked = WDOG_U64(req->rt.minflt_locked_hi, req->rt.minflt_locked_lo);
+	rt->majflt_locked = WDOG_U64(req->rt.majflt_locked_hi, req->rt.majflt_locked_lo);
+	rt->runtime = req->rt.runtime;
+	rt->deadline = req->rt.deadline;
+	rt->period = req->rt.period;
+}
+
+int wdog_realtime(wdog_realtime_t *rt)
+{
+	wdog_realtime_t *list = NULL;
+	int rc;
+
+	if (!rt) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	rc = collect(WDOG_REALTIME_CMD, (void **)&list,
+		     sizeof(wdog_realtime_t), store_realtime);
+	if (rc <= 0) {
+		if (!rc)
+			errno = EIO;
+		free(list);
+		return -1;
+	}
+
+	*rt = list[0];
+	free(list);
+
+	return 0;
+}
+
 int wdog_unsubscribe(int id, unsigned int ack)
 {
 	return doit(WDOG_UNSUBSCRIBE_CMD, id, NULL, 0, &ack);
@@ -365,7 +654,21 @@ int wdog_status(int *status)
 
 int wdog_failed(wdog_code_t code, int pid, char *label, unsigned int timeout)
 {
-	return doit(code + WDOG_FAILED_BASE_CMD, pid, label, timeout, NULL);
+	wdog_t req;
+
+	if (code <= WDOG_CPU_OVERLOAD)
+		return doit(code + WDOG_FAILED_BASE_CMD, pid, label, timeout, NULL);
+	if (code > WDOG_WDT_KICK_FAILED) {
+		errno = EINVAL;
+		return -errno;
+	}
+
+	/* Later codes would collide with other commands */
+	init(&req, WDOG_FAILED_CODE_CMD, pid, label);
+	req.timeout = timeout;
+	req.error   = code;
+
+	return request(&req);
 }
 
 int wdog_reset(pid_t pid, char *label)
@@ -464,6 +767,21 @@ char *wdog_reset_reason_str(wdog_reason_t *reason)
 	case WDOG_CPU_OVERLOAD:
 		return "CPU overload";
 
+	case WDOG_PROCESS_STARVED:
+		return "Starved of CPU";
+
+	case WDOG_PROCESS_BLOCKED:
+		return "Blocked";
+
+	case WDOG_PROCESS_SPINNING:
+		return "Spinning";
+
+	case WDOG_WDT_PRETIMEOUT:
+		return "Watchdog pretimeout";
+
+	case WDOG_WDT_KICK_FAILED:
+		return "Watchdog kick failed";
+
 	case WDOG_FAILED_UNKNOWN:
 	default:
 		break;
@@ -482,6 +800,11 @@ int wdog_reload(void)
 	return doit(WDOG_RELOAD_CMD, -1, NULL, 0, NULL);
 }
 
+int wdog_upgrade(void)
+{
+	return doit(WDOG_UPGRADE_CMD, -1, NULL, 0, NULL);
+}
+
 /**
  * Local Variables:
  *  c-file-style: "linux"
@@ -55,6 +55,11 @@ typedef enum {
 	WDOG_DESCRIPTOR_LEAK,	      /**< filenr  pluing */
 	WDOG_MEMORY_LEAK,	      /**< meminfo plugin */
 	WDOG_CPU_OVERLOAD,	      /**< loadavg plugin */
+	WDOG_PROCESS_STARVED,	      /**< Supervised process, runnable but not scheduled */
+	WDOG_PROCESS_BLOCKED,	      /**< Supervised process, sleeping */
+	WDOG_PROCESS_SPINNING,	      /**< Supervised process, running but not kicking */
+	WDOG_WDT_PRETIMEOUT,	      /**< WDT about to fire, kicks stalled */
+	WDOG_WDT_KICK_FAILED,	      /**< WDT kicks keep failing, no standby WDT */
 } wdog_code_t;
 
 /** Reset reason data */
@@ -78,6 +83,87 @@ typedef struct
 	unsigned int  time_left; /**< Time left until timeout in milliseconds */
 } wdog_client_t;
 
+/** Max number of latency samples per kick, see wdog_kick_latency() */
+#define WDOG_LATENCY_SAMPLES 24
+
+/** Max number of checkpoint stages per subscriber, see wdog_stage() */
+#define WDOG_STAGE_MAX       8
+/** Max length of a stage name, including terminating zero */
+#define WDOG_STAGE_NAMELEN   16
+
+/** Max length of a group name, including terminating zero */
+#define WDOG_GROUP_NAMELEN   32
+
+/** Max number of threads supervised in-process, see wdog_thread_subscribe() */
+#define WDOG_THREAD_MAX      64
+
+/** Subscribed client statistics, all times in milliseconds */
+typedef struct
+{
+	int           id;           /**< Client ID */
+	pid_t         pid;          /**< Process ID */
+	char          label[48];    /**< Process name or label */
+	unsigned int  timeout;      /**< Timeout in milliseconds */
+	unsigned int  kicks;        /**< Number of kicks since subscribe */
+	unsigned int  interval_p50; /**< Median kick-to-kick interval */
+	unsigned int  interval_p99; /**< 99th percentile kick-to-kick interval */
+	unsigned int  interval_max; /**< Longest kick-to-kick interval */
+	int           margin_min;   /**< Lowest time left before deadline at kick */
+	unsigned int  near_misses;  /**< Number of soft deadlines crossed */
+	unsigned int  rate;         /**< Work per second in last window, see wdog_kick_work() */
+	unsigned int  latency_p99;  /**< Loop latency p99 (usec) in last window, see wdog_kick_latency() */
+	unsigned int  drifts;       /**< Number of times the kick interval has drifted from normal */
+} wdog_stats_t;
+
+/** Persistent per-label statistics, kept across reboots */
+typedef struct
+{
+	char          label[48];    /**< Process name or label */
+	unsigned long long kicks;   /**< Total number of kicks */
+	unsigned int  starts;       /**< Number of times subscribed */
+	unsigned int  misses;       /**< Number of failures, e.g., missed deadlines */
+	unsigned int  near_misses;  /**< Number of soft deadlines crossed */
+	int           margin_min;   /**< Lowest time left before deadline at kick */
+	time_t        last_seen;    /**< Last start or failure */
+} wdog_history_t;
+
+/** Watchdog device data */
+typedef struct
+{
+	char          name[48];     /**< Device node, e.g. /dev/watchdog */
+	unsigned int  timeout;      /**< Timeout in milliseconds */
+	unsigned int  interval;     /**< Kick interval in milliseconds */
+	int           timeleft;     /**< Time left (sec) at last check, -1 if not supported by driver */
+	int           timeleft_min; /**< Lowest time left (sec) seen, -1 if not supported by driver */
+	int           adaptive;     /**< Adaptive kicking, kick at this time left (sec), 0: disabled */
+	unsigned int  wakeups;      /**< Number of kick timer wakeups */
+	unsigned int  late_p50;     /**< Median kick timer lateness (usec) */
+	unsigned int  late_p99;     /**< 99th percentile kick timer lateness (usec) */
+	unsigned int  late_max;     /**< Worst kick timer lateness (usec) */
+	unsigned int  failures;     /**< Number of failed kicks */
+	unsigned int  kick_p99;     /**< 99th percentile kick (ioctl) latency (usec) */
+	unsigned int  kick_max;     /**< Worst kick (ioctl) latency (usec) */
+	int           standby;      /**< Standby device, not yet taken into service */
+} wdog_device_t;
+
+/** Real-time status of watchdogd */
+typedef struct
+{
+	char          cpus[48];     /**< CPU affinity, e.g. "0-1" */
+	int           policy;       /**< Scheduling policy, e.g. SCHED_RR */
+	int           priority;     /**< Real-time priority, 0 for SCHED_OTHER */
+	int           locked;       /**< Memory locked in RAM */
+	unsigned int  stack_kib;    /**< Prefaulted stack, in KiB */
+	unsigned int  heap_kib;     /**< Prefaulted heap, in KiB */
+	unsigned long long minflt;  /**< Minor page faults since start */
+	unsigned long long majflt;  /**< Major page faults since start */
+	unsigned long long minflt_locked; /**< Minor page faults since memory was locked and prefaulted */
+	unsigned long long majflt_locked; /**< Major page faults since memory was locked and prefaulted */
+	unsigned int  runtime;      /**< SCHED_DEADLINE runtime (usec), 0 for other policies */
+	unsigned int  deadline;     /**< SCHED_DEADLINE relative deadline (usec) */
+	unsigned int  period;       /**< SCHED_DEADLINE period (usec) */
+} wdog_realtime_t;
+
 /** @privatesection */
 
 /*
@@ -86,6 +172,7 @@ typedef struct
  */
 int   wdog_ping             (void);
 int   wdog_reload           (void);
+int   wdog_upgrade          (void);
 
 int   wdog_enable           (int enable);   /* Attempt to temp. disable */
 int   wdog_status           (int *status);  /* Check if enabled */
@@ -244,6 +331,127 @@ int wdog_extend_kick(int id, unsigned int timeout, unsigned int *ack);
  */
 int wdog_kick2(int id, unsigned int *ack);
 
+/**
+ * Kick the watchdog and report progress
+ *
+ * Like wdog_kick2(), but also reports the subscriber's work counter,
+ * e.g., number of processed messages.  The counter must be increasing,
+ * it may wrap around.  If a throughput floor has been set, using
+ * wdog_throughput(), the supervisor takes action when the rate of work
+ * drops below the floor, even though the subscriber keeps kicking.
+ *
+ * @param id The ID returned from wdog_subscribe()
+ * @param work Current value of work counter
+ * @param[in,out] ack Pointer to ack received from last wdog API call.  Will be updated with new ack.
+ * @return 0 on success, negative on error (also sets @p errno)
+ */
+int wdog_kick_work(int id, unsigned int work, unsigned int *ack);
+
+/**
+ * Set throughput floor for a subscriber
+ *
+ * The rate of work, reported with wdog_kick_work(), is calculated over
+ * consecutive windows of @p window milliseconds.  If the rate in any
+ * window is below @p rate, watchdogd treats it as a failure to meet the
+ * deadline.  Set @p rate to zero to disable.
+ *
+ * @param id The ID returned from wdog_subscribe()
+ * @param rate Minimum work per second
+ * @param window Window, in milliseconds, at least the subscribe timeout
+ * @param[in,out] ack Pointer to ack received from last wdog API call.  Will be updated with new ack.
+ * @return 0 on success, negative on error (also sets @p errno)
+ */
+int wdog_throughput(int id, unsigned int rate, unsigned int window, unsigned int *ack);
+
+/**
+ * Kick the watchdog and report loop latency
+ *
+ * Like wdog_kick2(), but also reports a batch of loop latency samples,
+ * e.g., the time each iteration of the main loop took since last kick.
+ * At most #WDOG_LATENCY_SAMPLES are sent, if @p num is larger only the
+ * last samples in @p usec are sent.
+ *
+ * @param id The ID returned from wdog_subscribe()
+ * @param usec Array of latency samples, in microseconds
+ * @param num Number of samples in @p usec
+ * @param[in,out] ack Pointer to ack received from last wdog API call.  Will be updated with new ack.
+ * @return 0 on success, negative on error (also sets @p errno)
+ */
+int wdog_kick_latency(int id, unsigned int *usec, unsigned int num, unsigned int *ack);
+
+/**
+ * Set loop latency budget for a subscriber
+ *
+ * The p99 of all samples, reported with wdog_kick_latency(), is
+ * calculated over consecutive windows of @p window milliseconds.  Each
+ * window where the p99 exceeds @p budget is logged as a warning.  After
+ * @p periods consecutive windows over budget, watchdogd treats it as a
+ * failure to meet the deadline.  With @p periods zero it only warns.
+ * Set @p budget to zero to disable.
+ *
+ * @param id The ID returned from wdog_subscribe()
+ * @param budget Maximum p99 loop latency, in microseconds
+ * @param window Window, in milliseconds
+ * @param periods Number of consecutive windows over budget before action, or zero
+ * @param[in,out] ack Pointer to ack received from last wdog API call.  Will be updated with new ack.
+ * @return 0 on success, negative on error (also sets @p errno)
+ */
+int wdog_latency(int id, unsigned int budget, unsigned int window, unsigned int periods, unsigned int *ack);
+
+/**
+ * Declare a named checkpoint stage
+ *
+ * A subscriber's main loop can be split in up to #WDOG_STAGE_MAX named
+ * stages, each with its own latency budget.  Stages are declared in the
+ * order they run.  A kick starts the first stage, wdog_checkpoint()
+ * marks the end of a stage and the start of the next one.
+ *
+ * A stage that overruns its budget is logged, and if the subscriber
+ * misses its deadline, the stage in progress is appended to the label
+ * in the reset reason, e.g., "pipeline/classify".
+ *
+ * @param id The ID returned from wdog_subscribe()
+ * @param name Name of stage, at most #WDOG_STAGE_NAMELEN - 1 characters
+ * @param budget Stage budget in milliseconds
+ * @param[in,out] ack Pointer to ack received from last wdog API call.  Will be updated with new ack.
+ * @return Stage index on success, negative on error (also sets @p errno)
+ */
+int wdog_stage(int id, const char *name, unsigned int budget, unsigned int *ack);
+
+/**
+ * Report arrival at checkpoint, i.e., end of a stage
+ *
+ * This does not restart the subscriber's timer, it only records the
+ * time spent in @p stage.  Use one of the kick functions for that.
+ *
+ * @param id The ID returned from wdog_subscribe()
+ * @param stage Index of completed stage, returned by wdog_stage()
+ * @param[in,out] ack Pointer to ack received from last wdog API call.  Will be updated with new ack.
+ * @return 0 on success, negative on error (also sets @p errno)
+ */
+int wdog_checkpoint(int id, int stage, unsigned int *ack);
+
+/**
+ * Join a group of subscribers, e.g., a pool of identical workers
+ *
+ * Members of a group no longer have their own deadline.  Instead the
+ * group has a single timer, with the timeout of the subscriber that
+ * created it, and at each group deadline the number of members that
+ * have kicked since the last one are counted.  Action is only taken
+ * when fewer than @p quorum members are alive.  Members that exit
+ * leave the group.
+ *
+ * The group is created by the first subscriber to join it, @p quorum
+ * is ignored for the following members.
+ *
+ * @param id The ID returned from wdog_subscribe()
+ * @param group Name of group, at most #WDOG_GROUP_NAMELEN - 1 characters
+ * @param quorum Minimum number of live members, at least 1
+ * @param[in,out] ack Pointer to ack received from last wdog API call.  Will be updated with new ack.
+ * @return 0 on success, negative on error (also sets @p errno)
+ */
+int wdog_join(int id, const char *group, unsigned int quorum, unsigned int *ack);
+
 /**
  * Get list of currently subscribed clients
  *
@@ -274,6 +482,154 @@ int wdog_kick2(int id, unsigned int *ack);
  */
 int wdog_clients(wdog_client_t **clients);
 
+/**
+ * Get statistics of currently subscribed clients
+ *
+ * Like wdog_clients(), but returns the kick-to-kick interval
+ * distribution and the worst-case margin to the deadline for each
+ * subscribed client.  The interval percentiles are approximate, they
+ * are read from a log-bucketed histogram with at most 25% error.  The
+ * max interval is exact.  Use this data to tune timeouts and to spot
+ * services that are slowly degrading before they miss a deadline.
+ *
+ * The caller must free the returned array using free() when done.
+ *
+ * @param stats  Pointer to receive allocated array of client statistics
+ *
+ * @return Number of clients on success, negative on error (also sets @p errno)
+ */
+int wdog_client_stats(wdog_stats_t **stats);
+
+/**
+ * Get persistent statistics, per label
+ *
+ * Long-term statistics for every label that has subscribed to the
+ * process supervisor, kept across restarts and reboots when enabled
+ * in the statistics section of watchdogd.conf.  Use this to spot which
+ * services are trending towards missing their deadlines.
+ *
+ * The caller must free the returned array using free() when done.
+ *
+ * @param history  Pointer to receive allocated array of statistics
+ *
+ * @return Number of labels on success, negative on error (also sets @p errno)
+ */
+int wdog_history(wdog_history_t **history);
+
+/**
+ * Get status of all watchdog devices
+ *
+ * Returns the configured timeout and kick interval of each watchdog
+ * device, and the time left before it fires as reported by the driver
+ * using WDIOC_GETTIMELEFT.  The lowest time left seen is the actual
+ * safety margin of the system, under load.  The kick timer lateness,
+ * how long after its deadline the kick timer actually ran, is the best
+ * indicator of how close the system is to an overload-induced reset.
+ * Failed kicks, and the kick latency, tell if the driver is healthy.
+ *
+ * The caller must free the returned array using free() when done.
+ *
+ * @param devices  Pointer to receive allocated array of devices
+ *
+ * @return Number of devices on success, negative on error (also sets @p errno)
+ */
+int wdog_devices(wdog_device_t **devices);
+
+/**
+ * Get real-time status of watchdogd
+ *
+ * Returns the scheduling policy, CPU affinity, and whether memory is
+ * locked in RAM, see the realtime section of watchdogd.conf.  With
+ * SCHED_DEADLINE also the runtime budget, deadline, and period.  With
+ * memory locked and prefaulted, the page fault counters since lock
+ * should stay at zero, any increase is a page fault that could have
+ * delayed a WDT kick.
+ *
+ * @param rt  Pointer to receive real-time status
+ *
+ * @return POSIX OK(0) on success, non-zero on error (also sets @p errno)
+ */
+int wdog_realtime(wdog_realtime_t *rt);
+
+/*
+ * In-process thread supervisor API
+ */
+
+/**
+ * Start in-process thread supervisor
+ *
+ * For applications that want to supervise their own threads, at a finer
+ * granularity than the process supervisor in watchdogd allows.  Threads
+ * subscribe using wdog_thread_subscribe() and kick using
+ * wdog_thread_kick(), same semantics as the process supervisor, but
+ * without any IPC.  Kicking is only a clock read and atomic operations.
+ *
+ * This function subscribes the application to watchdogd, using @p label
+ * and @p timeout, and starts a checker thread which sends a heartbeat,
+ * at half the timeout, for as long as all threads are healthy.
+ *
+ * When a thread misses its deadline, or kicks with the wrong ack, the
+ * optional @p cb is called from the checker thread with the thread ID,
+ * its label, and @p arg.  If @p cb returns zero the failure is handled
+ * and the thread is no longer supervised.  If @p cb returns non-zero,
+ * or there is no callback, the heartbeat stops and watchdogd takes
+ * action within @p timeout milliseconds.
+ *
+ * Link with -lpthread.
+ *
+ * @param label Name of the application. If @c NULL, process ID will be used.
+ * @param timeout Timeout of the application heartbeat, in milliseconds
+ * @param cb Optional failure callback, or @c NULL
+ * @param arg Optional argument to @p cb
+ * @return POSIX OK(0) on success, non-zero on error (also sets @p errno)
+ */
+int wdog_thread_init(char *label, unsigned int timeout, int (*cb)(int id, const char *label, void *arg), void *arg);
+
+/**
+ * Stop in-process thread supervisor
+ *
+ * Stops the checker thread, drops all subscribed threads, and
+ * unsubscribes the application from watchdogd.
+ *
+ * @return POSIX OK(0) on success, non-zero on error (also sets @p errno)
+ */
+int wdog_thread_exit(void);
+
+/**
+ * Start supervising a thread
+ *
+ * Like wdog_subscribe(), but for a thread in this process.  At most
+ * #WDOG_THREAD_MAX threads can be supervised.
+ *
+ * @param label Name of this thread. If @c NULL, "threadID" is used.
+ * @param timeout Timeout in microseconds
+ * @param[out] ack out-parameter - the value must be passed to next API call
+ * @return ID on success, negative on error (also sets @p errno)
+ */
+int wdog_thread_subscribe(char *label, unsigned int timeout, unsigned int *ack);
+
+/**
+ * Stop supervising a thread
+ *
+ * @param id The ID returned from wdog_thread_subscribe()
+ * @param ack Last ack received from wdog_thread_kick()
+ * @return 0 on success, negative on error (also sets @p errno)
+ */
+int wdog_thread_unsubscribe(int id, unsigned int ack);
+
+/**
+ * Kick the thread supervisor
+ *
+ * Checks ack, moves the thread's deadline and updates @p ack.  A wrong
+ * ack is treated as a failure, like a failed kick in watchdogd.  Safe
+ * to call from any thread, lock free.
+ *
+ * @param id The ID returned from wdog_thread_subscribe()
+ * @param[in,out] ack Pointer to ack received from last API call.  Will be updated with new ack.
+ * @return 0 on success, negative on error (also sets @p errno)
+ */
+int wdog_thread_kick(int id, unsigned int *ack);
+
 /*
  * Compatibility wrapper layer
  */
@@ -17,9 +17,16 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <fnmatch.h>
+#include <glob.h>
+#include <sys/inotify.h>
 #include "finit.h"
 #include "wdt.h"
 #include "rr.h"
+#include "forensic.h"
+#include "history.h"
+#include "realtime.h"
+#include "reexec.h"
 #include "supervisor.h"
 
 /* Watchdogd reset reason as read at boot */
@@ -29,6 +36,15 @@ unsigned int  reset_counter = 0;
 
 static TAILQ_HEAD(devhead, wdt) devices = TAILQ_HEAD_INITIALIZER(devices);
 
+/* Health-gated kicking, who lost health, empty while healthy */
+static char lost[64];
+
+/* Hot-plug discovery of WDT device nodes */
+static int   hotplug;
+static char *hotplug_match;
+static int   hotplug_fd = -1;
+static uev_t hotplug_watcher;
+
 
 static const char *wdt_flags(unsigned int cause, int json)
 {
@@ -92,12 +108,51 @@ static struct wdt *find(const char *name)
 	return NULL;
 }
 
+/*
+ * Parse kick interval, "10" and "10s" are seconds, "250ms" milliseconds.
+ * Returns the interval in milliseconds, or -1 on error.
+ */
+int wdt_interval(const char *arg)
+{
+	char *end;
+	long val;
+
+	if (!arg)
+		return -1;
+
+	errno = 0;
+	val = strtol(arg, &end, 10);
+	if (errno || end == arg || val <= 0)
+		return -1;
+
+	if (!*end || !strcmp(end, "s"))
+		val *= 1000;
+	else if (strcmp(end, "ms"))
+		return -1;
+
+	/* Sanity check, no WDT has a timeout anywhere near this */
+	if (val > 3600 * 1000)
+		return -1;
+
+	return (int)val;
+}
+
+/* Iterate over all devices, start with %NULL */
+struct wdt *wdt_next(struct wdt *dev)
+{
+	if (!dev)
+		return TAILQ_FIRST(&devices);
+
+	return TAILQ_NEXT(dev, link);
+}
+
 void wdt_mark(void)
 {
 	struct wdt *dev;
 
 	TAILQ_FOREACH(dev, &devices, link) {
-		if (!dev->dirty)
+		/* Hot-plugged devices are not in the .conf */
+		if (!dev->dirty && !dev->hotplug)
 			dev->dirty = 1;
 	}
 }
@@ -117,13 +172,15 @@ void wdt_sweep(void)
 	}
 
 	if (TAILQ_EMPTY(&devices))
-		wdt_add(WDT_DEVNODE, period, timeout, magic, 1);
+		wdt_add(WDT_DEVNODE, period, timeout, pretimeout, adaptive, magic, 0, 1);
 
 	/* update permanent/default from global settings */
 	dev = TAILQ_FIRST(&devices);
 	if (dev && dev->dirty == -1) {
 		dev->timeout  = timeout;
 		dev->interval = period;
+		dev->pretimeout = pretimeout;
+		dev->adaptive = adaptive;
 		dev->magic    = magic;
 	}
 }
@@ -131,13 +188,17 @@ void wdt_sweep(void)
 /*
  * Add device node to list of active watchdogs
  */
-int wdt_add(const char *name, int interval, int timeout, int magic, int permanent)
+int wdt_add(const char *name, int interval, int timeout, int pretimeout,
+	    int adaptive, int magic, int standby, int permanent)
 {
 	struct wdt *dev;
 
 	if (!fexist(name)) {
-		ERROR("Cannot find %s, skipping.", name);
-		return 1;
+		if (!hotplug) {
+			ERROR("Cannot find %s, skipping.", name);
+			return 1;
+		}
+		LOG("%s: not found, waiting for it to appear.", name);
 	}
 
 	dev = find(name);
@@ -156,6 +217,9 @@ int wdt_add(const char *name, int interval, int timeout, int magic, int permanen
 		}
 
 		dev->fd = -1;
+		dev->gettimeleft = 1;
+		dev->timeleft = -1;
+		dev->margin = -1;
 		if (permanent) {
 			dev->dirty = -1;
 			TAILQ_INSERT_HEAD(&devices, dev, link);
@@ -167,7 +231,10 @@ int wdt_add(const char *name, int interval, int timeout, int magic, int permanen
 
 	dev->interval = interval;
 	dev->timeout  = timeout;
+	dev->pretimeout = pretimeout;
+	dev->adaptive = adaptive;
 	dev->magic    = magic;
+	dev->standby  = standby;
 
 	return 0;
 }
@@ -182,8 +249,10 @@ int wdt_open(struct wdt *dev)
 		return 1;
 	}
 
-	dev->fd = open(dev->name, O_WRONLY);
-	if (dev->fd == -1) {
+	dev->fd = reexec_fd(dev->name);
+	if (dev->fd != -1) {
+		LOG("%s: adopted from previous instance.", dev->name);
+	} else if ((dev->fd = open(dev->name, O_WRONLY)) == -1) {
 		if (EBUSY != errno)
 			return -1;
 
@@ -240,6 +309,7 @@ int wdt_close(struct wdt *dev)
 		dev->fd = -1;
 	}
 	uev_timer_stop(&dev->watcher);
+	uev_timer_stop(&dev->pretimer);
 
 	return 0;
 }
@@ -320,6 +390,60 @@ int wdt_get_timeout(struct wdt *dev)
 	return count;
 }
 
+/*
+ * Ask the driver to raise its pretimeout @count sec before the timeout,
+ * what happens then is up to the kernel's pretimeout governor.
+ */
+static int wdt_set_pretimeout(struct wdt *dev, int count)
+{
+	int arg = count;
+
+	if (wdt_testmode() || dev->fd == -1)
+		return 0;
+
+	if (!wdt_capability(dev, WDIOF_PRETIMEOUT)) {
+		DEBUG("%s: driver does not support pretimeout, emulating.", dev->name);
+		return 0;
+	}
+
+	/* Driver replies with the pretimeout actually set */
+	if (ioctl(dev->fd, WDIOC_SETPRETIMEOUT, &arg)) {
+		PERROR("%s: failed setting pretimeout %d sec", dev->name, count);
+		return 1;
+	}
+	if (arg != count)
+		WARN("%s: pretimeout from driver %d, your setting %d.", dev->name, arg, count);
+
+	return 0;
+}
+
+/*
+ * Time left, in sec, before the WDT fires, or -1 if the driver does not
+ * support WDIOC_GETTIMELEFT.  Also tracks the lowest time left seen.
+ */
+static int wdt_get_timeleft(struct wdt *dev)
+{
+	int left;
+
+	if (wdt_testmode() || dev->fd == -1 || !dev->gettimeleft)
+		return -1;
+
+	if (ioctl(dev->fd, WDIOC_GETTIMELEFT, &left)) {
+		DEBUG("%s: driver does not support reading time left: %s", dev->name, strerror(errno));
+		dev->gettimeleft = 0;
+		return -1;
+	}
+
+	dev->timeleft = left;
+	if (dev->margin < 0 || left < dev->margin) {
+		if (dev->margin >= 0)
+			INFO("%s: new lowest time left before reset, %d sec.", dev->name, left);
+		dev->margin = left;
+	}
+
+	return left;
+}
+
 static int reset_was_powerloss(void)
 {
 	struct wdt *dev;
@@ -440,6 +564,9 @@ int wdt_fstore_reason(FILE *fp, wdog_reason_t *r, pid_t pid, int compat)
 		case WDOG_FAILED_KICK:
 		case WDOG_FAILED_UNSUBSCRIPTION:
 		case WDOG_FAILED_TO_MEET_DEADLINE:
+		case WDOG_PROCESS_STARVED:
+		case WDOG_PROCESS_BLOCKED:
+		case WDOG_PROCESS_SPINNING:
 			fprintf(fp, WDT_REASON_WID ": %ui\n", r->wid);
 			break;
 		default:
@@ -459,6 +586,9 @@ int wdt_fstore_reason(FILE *fp, wdog_reason_t *r, pid_t pid, int compat)
 		case WDOG_FAILED_KICK:
 		case WDOG_FAILED_UNSUBSCRIPTION:
 		case WDOG_FAILED_TO_MEET_DEADLINE:
+		case WDOG_PROCESS_STARVED:
+		case WDOG_PROCESS_BLOCKED:
+		case WDOG_PROCESS_SPINNING:
 			fprintf(fp, "    \"watchdog-id\": %u,\n", r->wid);
 			break;
 		default:
@@ -518,7 +648,10 @@ static int create_bootstatus(char *fn, wdog_reason_t *r, pid_t pid)
 		fprintf(fp, "      \"identity\": \"%s\",\n", dev->info.identity);
 		fprintf(fp, "      \"fw-version\": %u,\n", dev->info.firmware_version);
 		fprintf(fp, "      \"timeout\": %d,\n", dev->timeout);
-		fprintf(fp, "      \"interval\": %d,\n", dev->interval);
+		fprintf(fp, "      \"interval\": %d,\n", dev->interval / 1000);
+		fprintf(fp, "      \"interval-ms\": %d,\n", dev->interval);
+		fprintf(fp, "      \"pretimeout\": %d,\n", dev->pretimeout);
+		fprintf(fp, "      \"adaptive\": %d,\n", dev->adaptive);
 		fprintf(fp, "      \"safe-exit\": %s,\n", dev->magic ? "true" : "false");
 		fprintf(fp, "      \"capabilities\": {\n");
 		fprintf(fp, "        \"mask\":\"0x%04x\",\n", dev->info.options);
@@ -639,9 +772,404 @@ int wdt_enable(int enable)
 }
 
 
+/*
+ * The WDT is about to fire.  Either the kick timer is late, e.g. the
+ * event loop has been blocked, or the kicks fail.  This is our last
+ * chance to record why the system is going down: save a snapshot of
+ * ourselves, the statistics, and the reset reason, before the hardware
+ * pulls the plug.
+ */
+static void emergency(struct wdt *dev)
+{
+	wdog_reason_t reason;
+	int64_t ago;
+
+	if (dev->emergency)
+		return;
+	dev->emergency = 1;
+
+	ago = wdt_msec() - dev->kicked;
+	EMERG("%s: pretimeout, last kick %lld msec ago, reset in %lld msec!", dev->name,
+	      (long long)ago, (long long)dev->timeout * 1000 - ago);
+
+	history_flush();
+
+	/*
+	 * Health-gated, expected, keep the snapshot of the culprit and the
+	 * reset reason that got us here.
+	 */
+	if (lost[0])
+		return;
+
+	forensic_save(getpid(), prognm, &dev->kicked, 1);
+
+	memset(&reason, 0, sizeof(reason));
+	reason.code    = WDOG_WDT_PRETIMEOUT;
+	reason.counter = reset_counter + 1;
+	strlcpy(reason.label, dev->name, sizeof(reason.label));
+	if (!reset_reason_set(&reason, getpid()))
+		dev->rrsaved = 1;
+	sync();
+}
+
+/*
+ * We made it after all, prepare for an uncontrolled reset again.  Only
+ * if the reset reason is still ours, a reason recorded meanwhile, e.g.
+ * by the supervisor, must be kept.
+ */
+static void recovered(struct wdt *dev)
+{
+	wdog_reason_t reason;
+	pid_t pid;
+
+	LOG("%s: recovered from pretimeout, kicking again.", dev->name);
+	dev->emergency = 0;
+
+	if (!dev->rrsaved)
+		return;
+	dev->rrsaved = 0;
+
+	if (reset_reason_get(&reason, &pid) || reason.code != WDOG_WDT_PRETIMEOUT ||
+	    strncmp(reason.label, dev->name, sizeof(reason.label) - 1))
+		return;
+
+	memset(&reason, 0, sizeof(reason));
+	reason.code    = WDOG_FAILED_UNKNOWN;
+	reason.counter = reset_counter + 1;
+	reset_reason_clear(&reason);
+}
+
+static void pretimeout_cb(uev_t *w, void *arg, int event)
+{
+	emergency(arg);
+}
+
+/* Take the first standby WDT into service, returns 0 if one was found */
+static int failover(struct wdt *failed)
+{
+	struct wdt *dev;
+
+	TAILQ_FOREACH(dev, &devices, link) {
+		if (!dev->standby || dev->armed)
+			continue;
+
+		ERROR("%s: kicks keep failing, failing over to %s.", failed->name, dev->name);
+		dev->armed = 1;
+		wdt_init(failed->ctx, NULL);
+
+		return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * Repeated kick failures, fail over to a standby WDT, if any, or do a
+ * controlled reset with a reset reason, rather than wait for the WDT.
+ */
+static void escalate(struct wdt *dev)
+{
+	wdog_reason_t reason;
+
+	dev->escalated = 1;
+	if (!failover(dev))
+		return;
+
+	ERROR("%s: kicks keep failing, no standby WDT, resetting system.", dev->name);
+	memset(&reason, 0, sizeof(reason));
+	reason.code = WDOG_WDT_KICK_FAILED;
+	strlcpy(reason.label, dev->name, sizeof(reason.label));
+	wdt_reset(dev->ctx, getpid(), &reason, 0);
+}
+
+/*
+ * Kick with accounting of failures and ioctl latency.  A failed kick is
+ * retried once.  Escalate after kick-failures in a row, or sooner if
+ * the next kick would be too late anyway.
+ */
+static int keepalive(struct wdt *dev)
+{
+	int64_t start, len;
+	int rc, err;
+
+	start = wdt_usec();
+	rc = wdt_kick(dev, "Kicking watchdog.");
+	if (rc)
+		rc = wdt_kick(dev, "Retrying kick.");
+	err = errno;
+
+	len = wdt_usec() - start;
+	hist_add(&dev->latency, len > UINT32_MAX ? UINT32_MAX : (uint32_t)len);
+
+	if (!rc) {
+		if (dev->failed)
+			LOG("%s: kicking again after %d failed kicks.", dev->name, dev->failed);
+		dev->failed = 0;
+		dev->escalated = 0;
+		return 0;
+	}
+
+	dev->failures++;
+	dev->failed++;
+	WARN("%s: failed kicking WDT, %d in a row: %s", dev->name, dev->failed, strerror(err));
+
+	if (dev->escalated || kick_failures <= 0)
+		return -1;
+	if (dev->failed >= kick_failures ||
+	    wdt_msec() - dev->kicked + dev->interval >= (int64_t)dev->timeout * 1000)
+		escalate(dev);
+
+	return -1;
+}
+
+static void kick(struct wdt *dev)
+{
+	int deadline = 0;
+
+	/* Timers may expire in any order after a stall, check ourselves */
+	if (dev->pretimeout) {
+		deadline = (dev->timeout - dev->pretimeout) * 1000;
+		if (wdt_msec() - dev->kicked >= deadline)
+			emergency(dev);
+	}
+
+	if (keepalive(dev))
+		return;
+
+	dev->kicked = wdt_msec();
+	if (!dev->pretimeout)
+		return;
+
+	if (dev->emergency)
+		recovered(dev);
+	uev_timer_set(&dev->pretimer, deadline, 0);
+}
+
+/*
+ * Arm kick timer for the absolute monotonic @deadline, in usec.  The
+ * libuEv timers are relative, in msec, so round up to never be early.
+ */
+static void schedule(struct wdt *dev, int64_t deadline)
+{
+	int64_t msec;
+
+	dev->next = deadline;
+	msec = (deadline - wdt_usec() + 999) / 1000;
+	if (msec < 1)
+		msec = 1;
+
+	uev_timer_set(&dev->watcher, (int)msec, 0);
+}
+
+/*
+ * Kicks are scheduled at absolute deadlines, every interval from the
+ * previous deadline rather than from when we ran, so the schedule does
+ * not drift.  How late we run, compared to the deadline, is recorded.
+ *
+ * In adaptive mode the next kick is scheduled from the time left, as
+ * reported by the driver, rather than every interval.  If the driver
+ * stops reporting we fall back to the interval.
+ */
 static void period_cb(uev_t *w, void *arg, int event)
 {
-	wdt_kick(arg, "Kicking watchdog.");
+	struct wdt *dev = arg;
+	int64_t now, late, T;
+	int left;
+
+	now  = wdt_usec();
+	late = now - dev->next;
+	if (late < 0)
+		late = 0;
+	hist_add(&dev->late, late > UINT32_MAX ? UINT32_MAX : (uint32_t)late);
+	if (late > (int64_t)dev->interval * 500)
+		WARN("%s: kick timer %lld ms late!", dev->name, (long long)late / 1000);
+
+	/* Health-gated, no more kicks, let the WDT reset the system */
+	if (lost[0]) {
+		DEBUG("%s: health lost, %s, not kicking.", dev->name, lost);
+		return;
+	}
+
+	left = wdt_get_timeleft(dev);
+	if (dev->adaptive && left >= 0) {
+		if (left > dev->adaptive) {
+			schedule(dev, now + (int64_t)(left - dev->adaptive) * 1000000);
+			return;
+		}
+
+		kick(dev);
+		schedule(dev, now + (int64_t)(dev->timeout - dev->adaptive) * 1000000);
+		return;
+	}
+
+	kick(dev);
+
+	/* Skip any deadlines already passed, e.g., after a stall */
+	T = (int64_t)dev->interval * 1000;
+	if (dev->next + T <= now)
+		dev->next += ((now - dev->next) / T) * T;
+	schedule(dev, dev->next + T);
+}
+
+/*
+ * A WDT device node matching the hotplug pattern, unless listed in the
+ * .conf file, is added with the global settings.  The legacy node,
+ * /dev/watchdog, is the same WDT as /dev/watchdog0, so a node must also
+ * be listed in /sys/class/watchdog to be adopted.
+ */
+static int adopt(const char *path)
+{
+	const char *name = path + strlen(_PATH_DEV);
+	char sys[80];
+
+	if (find(path))
+		return 0;
+
+	if (!hotplug_match || fnmatch(hotplug_match, path, 0))
+		return -1;
+
+	snprintf(sys, sizeof(sys), "/sys/class/watchdog/%s", name);
+	if (!fexist(sys))
+		return -1;
+
+	if (wdt_add(path, period, timeout, pretimeout, adaptive, magic, 0, 0))
+		return -1;
+
+	find(path)->hotplug = 1;
+
+	return 0;
+}
+
+/*
+ * Called when a node is created in /dev, we only wake up when /dev
+ * changes, most of the time never after boot.
+ */
+static void hotplug_cb(uev_t *w, void *arg, int events)
+{
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t len;
+	char *ptr;
+	int num = 0;
+
+	len = read(w->fd, buf, sizeof(buf));
+	if (len <= 0)
+		return;
+
+	for (ptr = buf; ptr < buf + len; ptr += sizeof(*ev) + ev->len) {
+		char path[64];
+		struct wdt *dev;
+
+		ev = (const struct inotify_event *)ptr;
+		if (!ev->len || strncmp(ev->name, "watchdog", 8))
+			continue;
+
+		snprintf(path, sizeof(path), "%s%s", _PATH_DEV, ev->name);
+		if (adopt(path))
+			continue;
+
+		dev = find(path);
+		if (!dev || dev->fd != -1 || (dev->standby && !dev->armed))
+			continue;
+
+		LOG("%s: hot-plugged, starting.", path);
+		num++;
+	}
+
+	if (num)
+		wdt_init(w->ctx, NULL);
+}
+
+static void hotplug_start(uev_ctx_t *ctx)
+{
+	glob_t gl;
+	size_t i;
+
+	if (!hotplug) {
+		if (hotplug_fd != -1) {
+			uev_io_stop(&hotplug_watcher);
+			close(hotplug_fd);
+			hotplug_fd = -1;
+		}
+		return;
+	}
+
+	if (hotplug_fd == -1) {
+		hotplug_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (hotplug_fd == -1) {
+			PERROR("Failed starting hot-plug discovery");
+			return;
+		}
+
+		if (inotify_add_watch(hotplug_fd, _PATH_DEV, IN_CREATE | IN_MOVED_TO) == -1 ||
+		    uev_io_init(ctx, &hotplug_watcher, hotplug_cb, NULL, hotplug_fd, UEV_READ)) {
+			PERROR("Failed watching %s for WDT devices", _PATH_DEV);
+			close(hotplug_fd);
+			hotplug_fd = -1;
+			return;
+		}
+	}
+
+	/* Nodes that appeared before we started watching */
+	if (!hotplug_match || glob(hotplug_match, 0, NULL, &gl))
+		return;
+
+	for (i = 0; i < gl.gl_pathc; i++) {
+		if (strncmp(gl.gl_pathv[i], _PATH_DEV, strlen(_PATH_DEV)))
+			continue;
+		adopt(gl.gl_pathv[i]);
+	}
+	globfree(&gl);
+}
+
+/*
+ * Enable, or disable, hot-plug discovery.  Called before the devices
+ * in the .conf file are added, @match is an optional glob(7) pattern.
+ */
+int wdt_hotplug(int enable, const char *match)
+{
+	hotplug = enable;
+
+	if (hotplug_match)
+		free(hotplug_match);
+	hotplug_match = NULL;
+	if (enable && match && match[0])
+		hotplug_match = strdup(match);
+
+	return 0;
+}
+
+/* Send one wdog_t per device, same as supervisor_list_clients() */
+int wdt_list(int sd)
+{
+	struct wdt *dev;
+	wdog_t resp;
+
+	TAILQ_FOREACH(dev, &devices, link) {
+		memset(&resp, 0, sizeof(resp));
+		resp.cmd = WDOG_DEVICES_CMD;
+		strlcpy(resp.label, dev->name, sizeof(resp.label));
+		resp.device.timeout  = dev->timeout * 1000;
+		resp.device.interval = dev->interval;
+		resp.device.timeleft = dev->timeleft;
+		resp.device.margin   = dev->margin;
+		resp.device.adaptive = dev->adaptive;
+		resp.device.kicks    = dev->late.count;
+		resp.device.p50      = hist_percentile(&dev->late, 50);
+		resp.device.p99      = hist_percentile(&dev->late, 99);
+		resp.device.max      = dev->late.max;
+		resp.device.failures = dev->failures;
+		resp.device.lat_p99  = hist_percentile(&dev->latency, 99);
+		resp.device.lat_max  = dev->latency.max;
+		resp.device.standby  = dev->standby && !dev->armed;
+
+		if (write(sd, &resp, sizeof(resp)) != sizeof(resp)) {
+			PERROR("Failed sending device status");
+			return -1;
+		}
+	}
+
+	return 0;
 }
 
 /*
@@ -660,13 +1188,20 @@ int wdt_init(uev_ctx_t *ctx, const char *name)
 		if (!find(name)) {
 			DEBUG("Adding command line device %s, interval %d, timeout %d, safe-exit %d",
 			      name, period, timeout, magic);
-			wdt_add(name, period, timeout, magic, 1);
+			wdt_add(name, period, timeout, pretimeout, adaptive, magic, 0, 1);
 		}
 	}
 
+	if (ctx)
+		hotplug_start(ctx);
+
 	TAILQ_FOREACH(dev, &devices, link) {
 		int T, rc, tmo;
 
+		/* Opening most WDTs starts them, wait for failover */
+		if (dev->standby && !dev->armed)
+			continue;
+
 		rc = wdt_open(dev);
 		if (rc)
 			continue;
@@ -689,34 +1224,76 @@ int wdt_init(uev_ctx_t *ctx, const char *name)
 				dev->timeout = tmo;
 			}
 
-			if (tmo <= dev->interval) {
-				ERROR("%s: warning, timeout <= kick interval! (%d <= %d)", dev->name,
-				      tmo, dev->interval);
+			if (tmo * 1000 <= dev->interval) {
+				ERROR("%s: timeout <= kick interval! (%d sec <= %d ms), using half the timeout.",
+				      dev->name, tmo, dev->interval);
+				dev->interval = 0;
 			}
 		}
 
 		/* If user did not provide '-t' interval, set to half WDT timeout */
 		if (!dev->interval) {
 			DEBUG("Missing interval, calculating: %d / 2", dev->timeout);
-			dev->interval = dev->timeout / 2;
+			dev->interval = dev->timeout * 1000 / 2;
 			if (!dev->interval)
-				dev->interval = 1;
+				dev->interval = 1000;
 		}
 
-		/* Calculate period (T) in milliseconds for libuEv */
-		T = dev->interval * 1000;
-		DEBUG("%s: kick interval set to %d sec.", dev->name, dev->interval);
+		/* Period (T) in milliseconds for libuEv */
+		T = dev->interval;
+		DEBUG("%s: kick interval set to %d ms.", dev->name, dev->interval);
 
 		/*
 		 * On SIGHUP this stops the current kick before re-init.
 		 * Otherwise this does nothing, libuEv takes care of us.
 		 */
 		uev_timer_stop(&dev->watcher);
+		uev_timer_stop(&dev->pretimer);
 
-		/* Every period (T) seconds we kick the WDT */
-		uev_timer_init(dev->ctx, &dev->watcher, period_cb, dev, T, T);
+		if (dev->adaptive && dev->adaptive >= dev->timeout) {
+			ERROR("%s: adaptive %d sec must be less than timeout, disabling.",
+			      dev->name, dev->adaptive);
+			dev->adaptive = 0;
+		}
+		if (dev->adaptive && dev->adaptive <= dev->pretimeout) {
+			ERROR("%s: adaptive %d sec must be more than pretimeout, disabling.",
+			      dev->name, dev->adaptive);
+			dev->adaptive = 0;
+		}
+		if (dev->adaptive) {
+			if (wdt_get_timeleft(dev) < 0) {
+				WARN("%s: adaptive kicking not possible, using kick interval.", dev->name);
+				dev->adaptive = 0;
+			} else
+				DEBUG("%s: adaptive kicking at %d sec time left.", dev->name, dev->adaptive);
+		}
+
+		dev->kicked = wdt_msec();
+		if (dev->pretimeout) {
+			int deadline = (dev->timeout - dev->pretimeout) * 1000;
+
+			if (deadline <= T) {
+				ERROR("%s: pretimeout %d sec leaves no room for kick interval, disabling.",
+				      dev->name, dev->pretimeout);
+				dev->pretimeout = 0;
+			} else {
+				wdt_set_pretimeout(dev, dev->pretimeout);
+				uev_timer_init(dev->ctx, &dev->pretimer, pretimeout_cb, dev, deadline, 0);
+			}
+		}
+
+		if (health_gated)
+			DEBUG("%s: health-gated, reset in at most %d sec after health is lost.",
+			      dev->name, dev->timeout);
+
+		/* Every period (T) milliseconds we kick the WDT */
+		dev->next = wdt_usec() + (int64_t)T * 1000;
+		uev_timer_init(dev->ctx, &dev->watcher, period_cb, dev, T, 0);
 	}
 
+	/* Kick interval may have changed, adjust SCHED_DEADLINE period */
+	realtime_update();
+
 	/* Save/update /run/watchdogd/status */
 	return save_bootstatus();
 }
@@ -778,6 +1355,44 @@ static void reboot_timeout_cb(uev_t *w, void *arg, int events)
 	wdt_reboot(w->ctx);
 }
 
+/* Returns 0 once health is lost in health-gated mode, 1 otherwise */
+int wdt_healthy(void)
+{
+	return !lost[0];
+}
+
+/*
+ * Health-gated kicking: stop kicking all WDTs, for good.  The system is
+ * then reset by the WDT within its timeout of the last kick, i.e., at
+ * the latest one timeout from now, regardless of how the orderly reboot
+ * in userspace fares, if it is even started.
+ */
+static void health_lost(const char *who)
+{
+	struct wdt *dev;
+	int64_t now, left = 0;
+
+	if (!health_gated || lost[0])
+		return;
+
+	strlcpy(lost, who, sizeof(lost));
+
+	now = wdt_msec();
+	TAILQ_FOREACH(dev, &devices, link) {
+		int64_t msec;
+
+		if (dev->fd == -1)
+			continue;
+
+		msec = dev->kicked + (int64_t)dev->timeout * 1000 - now;
+		if (msec > left)
+			left = msec;
+	}
+
+	ERROR("Health lost, %s, WDT kicks stopped, reset in at most %lld msec.",
+	      lost, (long long)left);
+}
+
 /*
  * Exit and reboot system -- reason for reboot is stored in some form of
  * semi-persistent backend, using @pid and @label, defined at compile
@@ -803,7 +1418,8 @@ int wdt_reset(uev_ctx_t *ctx, pid_t pid, wdog_reason_t *reason, int timeout)
 	else
 		DEBUG("Reboot requested by pid %d, label %s, timeout: %d ...", pid, reason->label, timeout);
 
-	/* Save reset cause */
+	/* Save statistics and reset cause */
+	history_flush();
 	reason->counter = reset_counter + 1;
 	reset_reason_set(reason, pid);
 
@@ -811,6 +1427,13 @@ int wdt_reset(uev_ctx_t *ctx, pid_t pid, wdog_reason_t *reason, int timeout)
 	if (timeout < 0)
 		return 0;
 
+	if (health_gated) {
+		char who[64];
+
+		snprintf(who, sizeof(who), "%s %s", wdog_get_reason_str(reason), reason->label);
+		health_lost(who);
+	}
+
 	if (!rebooting && is_finit_system()) {
 		in_progress = 1;
 		kill(1, SIGTERM);
@@ -37,6 +37,8 @@
 #include <paths.h>
 #include <syslog.h>
 #include <sched.h>
+#include <stdint.h>
+#include <time.h>
 
 #ifdef _LIBITE_LITE
 # include <libite/lite.h>
@@ -49,6 +51,7 @@
 
 #include "private.h"
 #include "wdog.h"
+#include "hist.h"
 
 #define WDT_DEVNODE          _PATH_DEV      "watchdog"
 #define WDT_TIMEOUT_DEFAULT  20
@@ -78,13 +81,34 @@ struct wdt {
 	char *name;
 	int   fd;
 
-	int   timeout;
-	int   interval;
+	int   timeout;	/* sec */
+	int   interval;	/* msec */
 	int   magic;
+	int   pretimeout;	/* sec before timeout, 0: disabled */
+	int   adaptive;		/* kick at sec time left, 0: disabled */
+	int   standby;		/* only opened on failover */
+	int   armed;		/* standby device taken into service */
 
 	uev_ctx_t *ctx;
 	uev_t watcher;
+	uev_t pretimer;		/* emulated pretimeout, if enabled */
+	int64_t kicked;		/* msec, last successful kick */
+	int   emergency;
+	int   rrsaved;		/* emergency() stored the reset reason */
+
+	unsigned int failures;	/* failed kicks, total */
+	int   failed;		/* failed kicks in a row */
+	int   escalated;
+	struct hist latency;	/* usec, WDIOC_KEEPALIVE duration */
+
+	int64_t next;		/* usec, scheduled kick deadline */
+	struct hist late;	/* usec, kick timer lateness */
+
+	int   gettimeleft;	/* driver supports WDIOC_GETTIMELEFT */
+	int   timeleft;		/* sec, last read, or -1 */
+	int   margin;		/* sec, lowest time left, or -1 */
 	int   dirty;		/* for mark & sweep */
+	int   hotplug;		/* added by hot-plug discovery */
 
 	struct watchdog_info info;
 	unsigned int reset_cause;
@@ -102,9 +126,14 @@ extern int   enabled;
 extern int   loglevel;
 extern int   period;
 extern int   timeout;
+extern int   pretimeout;
+extern int   adaptive;
+extern int   kick_failures;
+extern int   health_gated;
 extern int   rebooting;
 extern int   wait_reboot;
 extern char *__progname;
+extern char *prognm;
 #ifdef TEST_MODE
 extern int   __wdt_testmode;
 #endif
@@ -113,12 +142,20 @@ extern wdog_reason_t reset_reason;
 
 void wdt_mark           (void);
 void wdt_sweep          (void);
-int  wdt_add            (const char *name, int interval, int timeout, int magic, int permanent);
+int  wdt_add            (const char *name, int interval, int timeout, int pretimeout,
+			 int adaptive, int magic, int standby, int permanent);
 
 int  wdt_init           (uev_ctx_t *ctx, const char *dev);
 int  wdt_exit           (uev_ctx_t *ctx);
 int  wdt_reboot         (uev_ctx_t *ctx);
 
+int  wdt_interval       (const char *arg);
+
+int  wdt_hotplug        (int enable, const char *match);
+
+struct wdt *wdt_next    (struct wdt *dev);
+int  wdt_list           (int sd);
+
 int  wdt_open           (struct wdt *dev);
 int  wdt_close          (struct wdt *dev);
 
@@ -131,6 +168,8 @@ int  wdt_kick           (struct wdt *dev, const char *msg);
 int  wdt_set_timeout    (struct wdt *dev, int count);
 int  wdt_get_timeout    (struct wdt *dev);
 
+int  wdt_healthy        (void);
+
 int  wdt_reset          (uev_ctx_t *ctx, pid_t pid, wdog_reason_t *reason, int timeout);
 int  wdt_forced_reset   (uev_ctx_t *ctx, pid_t pid, char *label, int timeout);
 
@@ -142,6 +181,24 @@ static inline unsigned int wdt_reset_counter(void)
 	return reset_counter;
 }
 
+/* Monotonic time in milliseconds, used for deadlines and statistics */
+static inline int64_t wdt_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Monotonic time in microseconds, for kick timer lateness */
+static inline int64_t wdt_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 static inline int wdt_testmode(void)
 {
 #ifdef TEST_MODE